@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// File: Bulkhead.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "Bulkhead.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+Bulkhead::Bulkhead():
+  mLimit(0),
+  mInFlight(0),
+  mNumRejected(0),
+  mNumDemoted(0)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+Bulkhead::~Bulkhead()
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Take a slot for a stat
+//------------------------------------------------------------------------------
+bool
+Bulkhead::TryAcquire()
+{
+  // The outstanding stats are counted even without a limit for the report
+  unsigned int in_flight = mInFlight.fetch_add(1, std::memory_order_relaxed);
+
+  if (!mLimit || (in_flight < mLimit))
+    return true;
+
+  mInFlight.fetch_sub(1, std::memory_order_relaxed);
+  mNumRejected.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Give back the slot of a stat
+//------------------------------------------------------------------------------
+void
+Bulkhead::Release()
+{
+  mInFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Get the counters of the bulkhead
+//------------------------------------------------------------------------------
+void
+Bulkhead::GetCounters(unsigned int& in_flight, uint64_t& rejected,
+                      uint64_t& demoted) const
+{
+  in_flight = mInFlight.load(std::memory_order_relaxed);
+  rejected = mNumRejected.load(std::memory_order_relaxed);
+  demoted = mNumDemoted.load(std::memory_order_relaxed);
+}
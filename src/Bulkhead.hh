@@ -0,0 +1,128 @@
+// -----------------------------------------------------------------------------
+// File: Bulkhead.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_BULKHEAD_HH__
+#define __EOS_BULKHEAD_HH__
+
+/*----------------------------------------------------------------------------*/
+#include <atomic>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class Bulkhead limiting the number of stat requests outstanding in one
+//! space token, so that a slow token can not hold all the existence checks.
+//! A slot is held from the time a stat is sent until its reply arrives, even
+//! if the probe which sent it gave up on it.
+//------------------------------------------------------------------------------
+class Bulkhead
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    Bulkhead();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~Bulkhead();
+
+
+    //--------------------------------------------------------------------------
+    //! Set the maximum number of outstanding stats
+    //!
+    //! @param limit maximum number of outstanding stats, 0 if unlimited
+    //!
+    //--------------------------------------------------------------------------
+    void SetLimit(unsigned int limit)
+    {
+      mLimit = limit;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the maximum number of outstanding stats, 0 if unlimited
+    //--------------------------------------------------------------------------
+    unsigned int GetLimit() const
+    {
+      return mLimit;
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Take a slot for a stat, the refusals are counted
+    //!
+    //! @return true if successful, false if the token is at its limit
+    //!
+    //--------------------------------------------------------------------------
+    bool TryAcquire();
+
+
+    //--------------------------------------------------------------------------
+    //! Give back the slot of a stat whose reply arrived
+    //--------------------------------------------------------------------------
+    void Release();
+
+
+    //--------------------------------------------------------------------------
+    //! Check if the token is at its limit
+    //--------------------------------------------------------------------------
+    bool IsFull() const
+    {
+      return (mLimit &&
+              (mInFlight.load(std::memory_order_relaxed) >= mLimit));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Count an existence check which moved the token to the end of its order
+    //--------------------------------------------------------------------------
+    void AddDemoted()
+    {
+      mNumDemoted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the counters of the bulkhead
+    //!
+    //! @param in_flight outstanding stats
+    //! @param rejected stats not sent since the token was at its limit
+    //! @param demoted checks which probed the token last since it was full
+    //!
+    //--------------------------------------------------------------------------
+    void GetCounters(unsigned int& in_flight, uint64_t& rejected,
+                     uint64_t& demoted) const;
+
+  private:
+
+    unsigned int mLimit; ///< maximum number of outstanding stats
+    std::atomic<unsigned int> mInFlight; ///< outstanding stats
+    std::atomic<uint64_t> mNumRejected; ///< stats refused at the limit
+    std::atomic<uint64_t> mNumDemoted; ///< checks probing the token last
+};
+
+#endif //__EOS_BULKHEAD_HH__
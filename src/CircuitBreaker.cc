@@ -0,0 +1,245 @@
+// -----------------------------------------------------------------------------
+// File: CircuitBreaker.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "CircuitBreaker.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+CircuitBreaker::CircuitBreaker():
+  mState(eClosed),
+  mRetryUs(0),
+  mFailures(0),
+  mMaxFailures(0),
+  mOpenUs(0),
+  mMaxOpenUs(0),
+  mCurrentOpenUs(0),
+  mTrialInFlight(false),
+  mNumTrips(0),
+  mNumRejected(0),
+  mNumTrials(0)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+CircuitBreaker::~CircuitBreaker()
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Set the parameters
+//------------------------------------------------------------------------------
+void
+CircuitBreaker::Configure(unsigned int max_failures, uint64_t open_us,
+                          uint64_t max_open_us)
+{
+  mMaxFailures = max_failures;
+  mOpenUs = open_us;
+  mMaxOpenUs = (max_open_us > open_us ? max_open_us : open_us);
+  mCurrentOpenUs = mOpenUs;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if the checks are refused right now
+//------------------------------------------------------------------------------
+bool
+CircuitBreaker::IsOpen() const
+{
+  return ((mState.load(std::memory_order_acquire) == eOpen) &&
+          (LatencyStats::NowUs() < mRetryUs.load(std::memory_order_relaxed)));
+}
+
+
+//------------------------------------------------------------------------------
+// Request to start a check
+//------------------------------------------------------------------------------
+bool
+CircuitBreaker::Allow(bool& trial)
+{
+  trial = false;
+
+  if (mState.load(std::memory_order_acquire) == eClosed)
+    return true;
+
+  XrdSysMutexHelper lock(mMutex);
+  int state = mState.load(std::memory_order_relaxed);
+
+  if (state == eClosed)
+    return true;
+
+  if (state == eOpen)
+  {
+    if (LatencyStats::NowUs() < mRetryUs.load(std::memory_order_relaxed))
+    {
+      mNumRejected++;
+      return false;
+    }
+
+    mState.store(eHalfOpen, std::memory_order_release);
+  }
+
+  // Only one trial at a time, the others wait for its outcome
+  if (mTrialInFlight)
+  {
+    mNumRejected++;
+    return false;
+  }
+
+  mTrialInFlight = true;
+  mNumTrials++;
+  trial = true;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Record the outcome of an allowed check
+//------------------------------------------------------------------------------
+bool
+CircuitBreaker::Record(Outcome outcome, bool trial)
+{
+  if (!trial)
+  {
+    if (outcome == eSuccess)
+    {
+      // Avoid writing the shared counter when there is nothing to reset
+      if (mFailures.load(std::memory_order_relaxed))
+        mFailures.store(0, std::memory_order_relaxed);
+
+      return false;
+    }
+
+    if ((outcome == eUnknown) || !mMaxFailures ||
+        (mFailures.fetch_add(1, std::memory_order_relaxed) + 1 < mMaxFailures))
+      return false;
+
+    XrdSysMutexHelper lock(mMutex);
+
+    if (mState.load(std::memory_order_relaxed) != eClosed)
+      return false;
+
+    mNumTrips++;
+    mCurrentOpenUs = mOpenUs;
+    Open(LatencyStats::NowUs());
+    return true;
+  }
+
+  XrdSysMutexHelper lock(mMutex);
+  mTrialInFlight = false;
+
+  // A canary stat may have closed the breaker in the meantime
+  if ((outcome == eUnknown) ||
+      (mState.load(std::memory_order_relaxed) == eClosed))
+    return false;
+
+  if (outcome == eSuccess)
+  {
+    mFailures.store(0, std::memory_order_relaxed);
+    mCurrentOpenUs = mOpenUs;
+    mState.store(eClosed, std::memory_order_release);
+    return true;
+  }
+
+  // EOS is still unavailable, wait longer before the next trial
+  mCurrentOpenUs *= 2;
+
+  if (mCurrentOpenUs > mMaxOpenUs)
+    mCurrentOpenUs = mMaxOpenUs;
+
+  Open(LatencyStats::NowUs());
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Record the outcome of a canary stat
+//------------------------------------------------------------------------------
+bool
+CircuitBreaker::RecordCanary(bool ok)
+{
+  if (mState.load(std::memory_order_acquire) == eClosed)
+    return Record(ok ? eSuccess : eFailure, false);
+
+  XrdSysMutexHelper lock(mMutex);
+  uint64_t now = LatencyStats::NowUs();
+
+  if ((mState.load(std::memory_order_relaxed) == eClosed) ||
+      (now < mRetryUs.load(std::memory_order_relaxed)))
+    return false;
+
+  if (ok)
+  {
+    mFailures.store(0, std::memory_order_relaxed);
+    mCurrentOpenUs = mOpenUs;
+    mState.store(eClosed, std::memory_order_release);
+    return true;
+  }
+
+  // A failure is left to the outcome of the trial check in flight
+  if (mTrialInFlight)
+    return false;
+
+  mNumTrials++;
+  mCurrentOpenUs *= 2;
+
+  if (mCurrentOpenUs > mMaxOpenUs)
+    mCurrentOpenUs = mMaxOpenUs;
+
+  Open(now);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the counters of the breaker
+//------------------------------------------------------------------------------
+void
+CircuitBreaker::GetCounters(uint64_t& trips, uint64_t& rejected,
+                            uint64_t& trials) const
+{
+  trips = mNumTrips.load(std::memory_order_relaxed);
+  rejected = mNumRejected.load(std::memory_order_relaxed);
+  trials = mNumTrials.load(std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Open the breaker
+//------------------------------------------------------------------------------
+void
+CircuitBreaker::Open(uint64_t now_us)
+{
+  mFailures.store(0, std::memory_order_relaxed);
+  mRetryUs.store(now_us + mCurrentOpenUs, std::memory_order_relaxed);
+  mState.store(eOpen, std::memory_order_release);
+}
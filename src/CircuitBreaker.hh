@@ -0,0 +1,184 @@
+// -----------------------------------------------------------------------------
+// File: CircuitBreaker.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_CIRCUITBREAKER_HH__
+#define __EOS_CIRCUITBREAKER_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <atomic>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class CircuitBreaker tracking the availability of an EOS endpoint from the
+//! outcome of the existence checks and of the canary stats. It opens after a
+//! number of consecutive checks without any reply from EOS, and while open the
+//! checks are refused so that the locates go to the uplink at once. Once the
+//! open interval is over, a single trial check is let through (half-open): its
+//! success closes the breaker, its failure opens it again for twice as long.
+//------------------------------------------------------------------------------
+class CircuitBreaker
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! State of the breaker
+    //--------------------------------------------------------------------------
+    enum State
+    {
+      eClosed, ///< checks go to EOS
+      eOpen, ///< checks are refused
+      eHalfOpen ///< a trial check decides the next state
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Outcome of a check
+    //--------------------------------------------------------------------------
+    enum Outcome
+    {
+      eSuccess, ///< EOS replied
+      eFailure, ///< no reply from EOS, only errors and timeouts
+      eUnknown ///< no stat was sent
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    CircuitBreaker();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~CircuitBreaker();
+
+
+    //--------------------------------------------------------------------------
+    //! Set the parameters - must be called before any other method
+    //!
+    //! @param max_failures consecutive failures opening the breaker, 0 means
+    //!        it never opens
+    //! @param open_us time in microseconds the breaker stays open at first
+    //! @param max_open_us maximum time the breaker stays open
+    //!
+    //--------------------------------------------------------------------------
+    void Configure(unsigned int max_failures, uint64_t open_us,
+                   uint64_t max_open_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Check if the checks are refused right now, without taking the trial
+    //!
+    //! @return true if open and the open interval is not over, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool IsOpen() const;
+
+
+    //--------------------------------------------------------------------------
+    //! Request to start a check - the outcome of an allowed check must be
+    //! recorded with Record
+    //!
+    //! @param trial set to true if the check is the trial of the half-open
+    //!        breaker
+    //!
+    //! @return true if the check can start, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Allow(bool& trial);
+
+
+    //--------------------------------------------------------------------------
+    //! Record the outcome of an allowed check
+    //!
+    //! @param outcome outcome of the check
+    //! @param trial true if the check was the trial
+    //!
+    //! @return true if the state of the breaker changed, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Record(Outcome outcome, bool trial);
+
+
+    //--------------------------------------------------------------------------
+    //! Record the outcome of a canary stat. While the breaker is closed it
+    //! counts like a check, once the open interval is over it acts as the
+    //! trial, without waiting for a trial check still in flight to succeed.
+    //!
+    //! @param ok true if EOS replied
+    //!
+    //! @return true if the state of the breaker changed, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool RecordCanary(bool ok);
+
+
+    //--------------------------------------------------------------------------
+    //! Get current state
+    //--------------------------------------------------------------------------
+    State GetState() const
+    {
+      return static_cast<State>(mState.load(std::memory_order_acquire));
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the counters of the breaker
+    //!
+    //! @param trips times the breaker opened
+    //! @param rejected checks refused while open
+    //! @param trials trial checks let through
+    //!
+    //--------------------------------------------------------------------------
+    void GetCounters(uint64_t& trips, uint64_t& rejected,
+                     uint64_t& trials) const;
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Open the breaker - must be called with the lock held
+    //!
+    //! @param now_us current time in microseconds
+    //!
+    //--------------------------------------------------------------------------
+    void Open(uint64_t now_us);
+
+    mutable XrdSysMutex mMutex; ///< mutex protecting the state transitions
+    std::atomic<int> mState; ///< current state
+    std::atomic<uint64_t> mRetryUs; ///< end of the open interval
+    std::atomic<unsigned int> mFailures; ///< consecutive failures
+    unsigned int mMaxFailures; ///< consecutive failures opening the breaker
+    uint64_t mOpenUs; ///< initial open interval
+    uint64_t mMaxOpenUs; ///< maximum open interval
+    uint64_t mCurrentOpenUs; ///< open interval after the last trial failure
+    bool mTrialInFlight; ///< true while the trial check runs
+    std::atomic<uint64_t> mNumTrips; ///< times the breaker opened
+    std::atomic<uint64_t> mNumRejected; ///< checks refused
+    std::atomic<uint64_t> mNumTrials; ///< trial checks
+};
+
+#endif //__EOS_CIRCUITBREAKER_HH__
@@ -0,0 +1,344 @@
+// -----------------------------------------------------------------------------
+// File: EndpointSet.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "EndpointSet.hh"
+/*----------------------------------------------------------------------------*/
+#include <sstream>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+EndpointSet::EndpointSet():
+  mNext(0),
+  mNumUnavailable(0)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+EndpointSet::~EndpointSet()
+{
+  for (auto it = mEndpoints.begin(); it != mEndpoints.end(); ++it)
+  {
+    delete (*it)->fs;
+    delete *it;
+  }
+
+  mEndpoints.clear();
+}
+
+
+//------------------------------------------------------------------------------
+// Add an endpoint
+//------------------------------------------------------------------------------
+int
+EndpointSet::Add(const std::string& host, unsigned int port,
+                 unsigned int weight, Role role)
+{
+  if (mEndpoints.size() >= sMaxEndpoints)
+    return -1;
+
+  std::stringstream sstr;
+  sstr << host << ":" << port;
+  XrdCl::URL url(sstr.str());
+
+  if (!url.IsValid())
+    return -1;
+
+  for (auto it = mEndpoints.begin(); it != mEndpoints.end(); ++it)
+  {
+    if ((*it)->instance == sstr.str())
+      return -1;
+  }
+
+  Endpoint* endpoint = new Endpoint();
+  endpoint->host = host;
+  endpoint->port = port;
+  endpoint->instance = sstr.str();
+  endpoint->weight = (weight ? weight : 1);
+  endpoint->role = role;
+  endpoint->fs = new XrdCl::FileSystem(url);
+  mEndpoints.push_back(endpoint);
+  return static_cast<int>(mEndpoints.size() - 1);
+}
+
+
+//------------------------------------------------------------------------------
+// Set the parameters of the circuit breakers
+//------------------------------------------------------------------------------
+void
+EndpointSet::Configure(unsigned int max_failures, uint64_t open_us,
+                       uint64_t max_open_us)
+{
+  for (auto it = mEndpoints.begin(); it != mEndpoints.end(); ++it)
+    (*it)->breaker.Configure(max_failures, open_us, max_open_us);
+}
+
+
+//------------------------------------------------------------------------------
+// Pick the endpoint to redirect to without a check
+//------------------------------------------------------------------------------
+int
+EndpointSet::Pick()
+{
+  int index = Select(0, true);
+
+  if (index < 0)
+    index = Select(0, false);
+
+  if (index < 0)
+    mNumUnavailable++;
+
+  return index;
+}
+
+
+//------------------------------------------------------------------------------
+// Select the endpoint of an existence check
+//------------------------------------------------------------------------------
+int
+EndpointSet::Acquire(bool& trial)
+{
+  uint64_t excluded = 0;
+
+  while (true)
+  {
+    int index = Select(excluded, false);
+
+    if (index < 0)
+    {
+      mNumUnavailable++;
+      return -1;
+    }
+
+    Endpoint* endpoint = mEndpoints[index];
+
+    // A half-open breaker lets a single trial through
+    if (endpoint->breaker.Allow(trial))
+    {
+      endpoint->in_flight++;
+      endpoint->num_checks++;
+      return index;
+    }
+
+    excluded |= (1ull << index);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Account for the end of an existence check
+//------------------------------------------------------------------------------
+bool
+EndpointSet::Release(int index, CircuitBreaker::Outcome outcome, bool trial)
+{
+  Endpoint* endpoint = mEndpoints[index];
+  endpoint->in_flight--;
+  return endpoint->breaker.Record(outcome, trial);
+}
+
+
+//------------------------------------------------------------------------------
+// Pick the endpoint to redirect to by round trip time
+//------------------------------------------------------------------------------
+int
+EndpointSet::PickByRtt()
+{
+  int index = SelectByRtt(true);
+
+  // With all of them down, any endpoint is better than failing the request
+  if (index < 0)
+  {
+    mNumUnavailable++;
+    index = SelectByRtt(false);
+  }
+
+  if (index >= 0)
+    mEndpoints[index]->num_checks++;
+
+  return index;
+}
+
+
+//------------------------------------------------------------------------------
+// Add a round trip time sample of an endpoint
+//------------------------------------------------------------------------------
+void
+EndpointSet::AddRtt(int index, uint64_t rtt_us)
+{
+  // Exponential moving average giving 1/4 of the weight to the new sample,
+  // only the thread measuring the endpoint writes it
+  std::atomic<uint64_t>& avg = mEndpoints[index]->rtt_us;
+  uint64_t old_rtt = avg.load(std::memory_order_relaxed);
+  avg.store(old_rtt ? (3 * old_rtt + rtt_us) / 4 : rtt_us,
+            std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Get the name of a role
+//------------------------------------------------------------------------------
+const char*
+EndpointSet::GetRoleName(Role role)
+{
+  return (role == ePrimary ? "primary" : "backup");
+}
+
+
+//------------------------------------------------------------------------------
+// Get the name of the state of a breaker
+//------------------------------------------------------------------------------
+const char*
+EndpointSet::GetStateName(CircuitBreaker::State state)
+{
+  if (state == CircuitBreaker::eClosed)
+    return "closed";
+  else if (state == CircuitBreaker::eOpen)
+    return "open";
+
+  return "half-open";
+}
+
+
+//------------------------------------------------------------------------------
+// Select the least loaded endpoint relative to its weight
+//------------------------------------------------------------------------------
+int
+EndpointSet::Select(uint64_t excluded, bool closed_only)
+{
+  size_t num = mEndpoints.size();
+
+  if (!num)
+    return -1;
+
+  // Among equal loads the start rotates so that idle endpoints share the
+  // checks instead of the first one getting all of them
+  size_t start = mNext.fetch_add(1, std::memory_order_relaxed) % num;
+
+  for (int role = ePrimary; role <= eBackup; ++role)
+  {
+    int best = -1;
+    uint64_t best_load = 0;
+    uint64_t best_weight = 1;
+
+    for (size_t n = 0; n < num; ++n)
+    {
+      size_t i = (start + n) % num;
+      Endpoint* endpoint = mEndpoints[i];
+
+      if ((endpoint->role != role) || (excluded & (1ull << i)))
+        continue;
+
+      if (closed_only ?
+          (endpoint->breaker.GetState() != CircuitBreaker::eClosed) :
+          endpoint->breaker.IsOpen())
+        continue;
+
+      // Compare (in_flight + 1) / weight without a division, counting the
+      // new check makes the weights matter even when the endpoints are idle
+      uint64_t load = endpoint->in_flight.load(std::memory_order_relaxed) + 1;
+
+      if ((best < 0) || (load * best_weight < best_load * endpoint->weight))
+      {
+        best = static_cast<int>(i);
+        best_load = load;
+        best_weight = endpoint->weight;
+      }
+    }
+
+    if (best >= 0)
+      return best;
+  }
+
+  return -1;
+}
+
+
+//------------------------------------------------------------------------------
+// Pick an endpoint at random weighted by weight / rtt^2
+//------------------------------------------------------------------------------
+int
+EndpointSet::SelectByRtt(bool healthy_only)
+{
+  size_t num = mEndpoints.size();
+  double scores[sMaxEndpoints];
+
+  for (int role = ePrimary; role <= eBackup; ++role)
+  {
+    double total = 0;
+
+    for (size_t i = 0; i < num; ++i)
+    {
+      Endpoint* endpoint = mEndpoints[i];
+      scores[i] = 0;
+
+      if ((endpoint->role != role) ||
+          (healthy_only && endpoint->breaker.IsOpen()))
+        continue;
+
+      uint64_t rtt_us = endpoint->rtt_us.load(std::memory_order_relaxed);
+      double rtt_ms = (rtt_us ? rtt_us : sDefaultRttUs) / 1000.0;
+
+      // A sub-millisecond round trip time is as good as one millisecond
+      if (rtt_ms < 1.0)
+        rtt_ms = 1.0;
+
+      scores[i] = endpoint->weight / (rtt_ms * rtt_ms);
+      total += scores[i];
+    }
+
+    if (total <= 0)
+      continue;
+
+    // Cheap pseudo random number, splitmix64 of a shared counter
+    uint64_t z = mNext.fetch_add(1, std::memory_order_relaxed) *
+                 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= (z >> 31);
+    double target = total * ((z >> 11) * (1.0 / 9007199254740992.0));
+    int last = -1;
+
+    for (size_t i = 0; i < num; ++i)
+    {
+      if (scores[i] <= 0)
+        continue;
+
+      last = static_cast<int>(i);
+      target -= scores[i];
+
+      if (target < 0)
+        return last;
+    }
+
+    // Rounding may leave a tiny remainder
+    return last;
+  }
+
+  return -1;
+}
@@ -0,0 +1,270 @@
+// -----------------------------------------------------------------------------
+// File: EndpointSet.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_ENDPOINTSET_HH__
+#define __EOS_ENDPOINTSET_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdCl/XrdClFileSystem.hh"
+#include "CircuitBreaker.hh"
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class EndpointSet holding the endpoints which serve the same namespace,
+//! e.g. the master MGM and its read-only slave or the uplink redirectors. Each
+//! existence check goes to the least loaded endpoint, relative to its weight,
+//! among the healthy ones of the best role, while the redirects to an uplink
+//! favour the endpoints with the lowest round trip time. The health of an
+//! endpoint is tracked by its own circuit breaker, so that the requests fail
+//! over to the other endpoints as soon as the breaker of one opens. The
+//! endpoints are added in Configure and never removed afterwards.
+//------------------------------------------------------------------------------
+class EndpointSet
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Maximum number of endpoints
+    //--------------------------------------------------------------------------
+    static const size_t sMaxEndpoints = 64;
+
+    //--------------------------------------------------------------------------
+    //! Round trip time assumed for an endpoint not measured yet
+    //--------------------------------------------------------------------------
+    static const uint64_t sDefaultRttUs = 100000;
+
+    //--------------------------------------------------------------------------
+    //! Role of an endpoint
+    //--------------------------------------------------------------------------
+    enum Role
+    {
+      ePrimary, ///< used whenever healthy
+      eBackup ///< used only if no primary endpoint is healthy
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! EOS endpoint with its connection, health and load
+    //--------------------------------------------------------------------------
+    struct Endpoint
+    {
+      Endpoint(): port(0), weight(1), role(ePrimary), fs(0), in_flight(0),
+        num_checks(0), rtt_us(0), canary_in_flight(false), num_canaries(0),
+        num_canary_errors(0)
+      { }
+
+      std::string host; ///< host name used in the redirects
+      unsigned int port; ///< port used in the redirects
+      std::string instance; ///< host:port
+      unsigned int weight; ///< relative capacity of the endpoint
+      Role role; ///< role of the endpoint
+      XrdCl::FileSystem* fs; ///< file system object shared by all probes
+      CircuitBreaker breaker; ///< availability of the endpoint
+      std::atomic<unsigned int> in_flight; ///< existence checks in progress
+      std::atomic<uint64_t> num_checks; ///< existence checks or redirects sent
+      std::atomic<uint64_t> rtt_us; ///< smoothed round trip time, 0 if unknown
+      std::atomic<bool> canary_in_flight; ///< true while a canary stat or ping runs
+      std::atomic<uint64_t> num_canaries; ///< canary stats or pings sent
+      std::atomic<uint64_t> num_canary_errors; ///< ... without reply
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    EndpointSet();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~EndpointSet();
+
+
+    //--------------------------------------------------------------------------
+    //! Add an endpoint
+    //!
+    //! @param host host name
+    //! @param port port
+    //! @param weight relative capacity, at least 1
+    //! @param role role of the endpoint
+    //!
+    //! @return index of the endpoint, -1 if the url is not valid, the endpoint
+    //!         already exists or there are too many endpoints
+    //!
+    //--------------------------------------------------------------------------
+    int Add(const std::string& host, unsigned int port, unsigned int weight,
+            Role role);
+
+
+    //--------------------------------------------------------------------------
+    //! Set the parameters of the circuit breakers of all the endpoints
+    //!
+    //! @param max_failures consecutive failures opening a breaker, 0 means
+    //!        it never opens
+    //! @param open_us time in microseconds a breaker stays open at first
+    //! @param max_open_us maximum time a breaker stays open
+    //!
+    //--------------------------------------------------------------------------
+    void Configure(unsigned int max_failures, uint64_t open_us,
+                   uint64_t max_open_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of endpoints
+    //--------------------------------------------------------------------------
+    size_t GetSize() const
+    {
+      return mEndpoints.size();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get an endpoint
+    //!
+    //! @param index index of the endpoint
+    //!
+    //--------------------------------------------------------------------------
+    Endpoint& Get(int index)
+    {
+      return *mEndpoints[index];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Pick the endpoint to redirect to without a check, e.g. for an outcome
+    //! found in the cache. The endpoints whose breaker is closed are preferred.
+    //!
+    //! @return index of the endpoint, -1 if none is available
+    //!
+    //--------------------------------------------------------------------------
+    int Pick();
+
+
+    //--------------------------------------------------------------------------
+    //! Select the endpoint of an existence check and account for its load. If
+    //! the breaker of the selected endpoint refuses the check, the next one
+    //! is tried.
+    //!
+    //! @param trial set to true if the check is the trial of the breaker of
+    //!        the endpoint
+    //!
+    //! @return index of the endpoint, -1 if none is available. Otherwise the
+    //!         caller must call Release.
+    //!
+    //--------------------------------------------------------------------------
+    int Acquire(bool& trial);
+
+
+    //--------------------------------------------------------------------------
+    //! Account for the end of an existence check
+    //!
+    //! @param index index of the endpoint returned by Acquire
+    //! @param outcome outcome of the check
+    //! @param trial true if the check was the trial of the breaker
+    //!
+    //! @return true if the state of the breaker changed, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Release(int index, CircuitBreaker::Outcome outcome, bool trial);
+
+
+    //--------------------------------------------------------------------------
+    //! Pick the endpoint to redirect to at random, with a probability
+    //! proportional to its weight divided by the square of its round trip
+    //! time, among the healthy endpoints of the best role. If none is healthy
+    //! all of them are considered. The redirect is counted.
+    //!
+    //! @return index of the endpoint, -1 if the set is empty
+    //!
+    //--------------------------------------------------------------------------
+    int PickByRtt();
+
+
+    //--------------------------------------------------------------------------
+    //! Add a round trip time sample of an endpoint
+    //!
+    //! @param index index of the endpoint
+    //! @param rtt_us round trip time in microseconds
+    //!
+    //--------------------------------------------------------------------------
+    void AddRtt(int index, uint64_t rtt_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of locates for which no endpoint was available
+    //--------------------------------------------------------------------------
+    uint64_t GetNumUnavailable() const
+    {
+      return mNumUnavailable.load(std::memory_order_relaxed);
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the name of a role
+    //--------------------------------------------------------------------------
+    static const char* GetRoleName(Role role);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the name of the state of a breaker
+    //--------------------------------------------------------------------------
+    static const char* GetStateName(CircuitBreaker::State state);
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Select the least loaded endpoint relative to its weight
+    //!
+    //! @param excluded bit mask of the endpoints not to select
+    //! @param closed_only if true, only endpoints whose breaker is closed are
+    //!        selected, otherwise those whose open interval is over as well
+    //!
+    //! @return index of the endpoint, -1 if none
+    //!
+    //--------------------------------------------------------------------------
+    int Select(uint64_t excluded, bool closed_only);
+
+
+    //--------------------------------------------------------------------------
+    //! Pick an endpoint at random weighted by weight / rtt^2
+    //!
+    //! @param healthy_only if true, the endpoints whose breaker is open are
+    //!        skipped
+    //!
+    //! @return index of the endpoint, -1 if none
+    //!
+    //--------------------------------------------------------------------------
+    int SelectByRtt(bool healthy_only);
+
+    std::vector<Endpoint*> mEndpoints; ///< endpoints in configuration order
+    std::atomic<unsigned int> mNext; ///< rotates the start, seeds the picks
+    std::atomic<uint64_t> mNumUnavailable; ///< locates without any endpoint
+};
+
+#endif //__EOS_ENDPOINTSET_HH__
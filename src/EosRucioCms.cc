@@ -23,10 +23,13 @@
 
 /*----------------------------------------------------------------------------*/
 #include "EosRucioCms.hh"
+#include "RucioMd5.hh"
 /*----------------------------------------------------------------------------*/
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <list>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <fcntl.h>
@@ -43,6 +46,7 @@
 #include "XrdOuc/XrdOucStream.hh"
 #include "XrdOuc/XrdOucEnv.hh"
 #include "XrdOuc/XrdOucErrInfo.hh"
+#include "XrdOuc/XrdOucCallBack.hh"
 #include "XrdSfs/XrdSfsInterface.hh"
 #include "XrdSec/XrdSecEntity.hh"
 /*----------------------------------------------------------------------------*/
@@ -50,6 +54,9 @@
 // Singleton variable
 static XrdCmsClient* instance = NULL;
 
+// Buffer of each thread where the metalink responses are built
+static __thread char sMetalinkBuf[XrdOucEI::Max_Error_Len];
+
 using namespace XrdCms;
 namespace XrdCms
 {
@@ -58,6 +65,79 @@ namespace XrdCms
 };
 
 
+//------------------------------------------------------------------------------
+//! Locate request whose response is sent through the callback of the client
+//! once the existence check of the file is done
+//------------------------------------------------------------------------------
+class EosRucioCms::AsyncLocate: public PfnProbe::Listener,
+  public SingleFlight::Waiter, public StatDispatcher::Ticket
+{
+  public:
+
+    AsyncLocate(EosRucioCms* cms, const char* path, const char* tident,
+                bool metalink, bool direct):
+      mCms(cms), mPath(path), mTident(tident), mMetalink(metalink),
+      mDirect(direct)
+    { }
+
+    virtual ~AsyncLocate() { }
+
+    //! Start the probe led by this locate once the dispatcher admits it
+    void Dispatch()
+    {
+      StatDispatcher::Admission admission = mCms->mDispatcher.Acquire(this);
+
+      if (admission != StatDispatcher::eQueued)
+        Admitted(admission == StatDispatcher::eAdmitted);
+    }
+
+    //! Called when the dispatcher admits or sheds the probe
+    virtual void Admitted(bool admitted)
+    {
+      if (!admitted)
+      {
+        Reply(mCms->ShedCheck(mCheck, "EOS overloaded,"));
+        return;
+      }
+
+      mCheck.start_us = LatencyStats::NowUs();
+      mCheck.probe->StartAsync(this, &mCms->mProbeTimer);
+    }
+
+    //! Called when the probe led by this locate is done
+    virtual void ProbeDone(PfnProbe* probe)
+    {
+      Reply(mCms->EndCheck(mCheck));
+    }
+
+    //! Called when the check of a concurrent locate is done
+    virtual void FlightDone(const SingleFlight::Result& result)
+    {
+      Reply(result);
+    }
+
+    //! Send the response to the client and delete the request
+    void Reply(const SingleFlight::Result& result)
+    {
+      std::string target;
+      int code = 0;
+      int retc = mCms->GetResponse(mPath.c_str(), result, mTident.c_str(),
+                                   mMetalink, mDirect, target, code);
+      mCms->mNumPending--;
+      mCallBack.Reply(retc, code, target.c_str(), mPath.c_str());
+      delete this;
+    }
+
+    EosRucioCms* mCms; ///< plugin owning the request
+    std::string mPath; ///< requested path
+    std::string mTident; ///< client trace identifier
+    bool mMetalink; ///< if true, the client can follow a metalink
+    bool mDirect; ///< if true, the client can be sent to the FST of the file
+    PfnCheck mCheck; ///< existence check of the file
+    XrdOucCallBack mCallBack; ///< callback of the client
+};
+
+
 //------------------------------------------------------------------------------
 // CMS client instantiator
 //------------------------------------------------------------------------------
@@ -87,12 +167,62 @@ EosRucioCms::EosRucioCms(XrdSysLogger* logger):
   mSiteName(""),
   mJsonFile(""),
   mAgisSite(""),
-  mEosInstance(""),
   mEosHost(""),
   mEosPort(0),
-  mUplinkInstance(""),
   mUplinkHost(""),
-  mUplinkPort(0)
+  mUplinkPort(0),
+  mUplinkPing(10),
+  mProbeMode(PfnProbe::eSequential),
+  mHedgePct(95),
+  mReportInterval(300),
+  mLocateDeadline(0),
+  mKeepAlive(60),
+  mMaxChecks(256),
+  mTokenLimit(128),
+  mBreakerFailures(5),
+  mBreakerOpen(10),
+  mCanaryPath(""),
+  mCanaryInterval(5),
+  mQueueSize(1024),
+  mQueueWait(1000),
+  mCacheSize(16),
+  mCacheTtl(60),
+  mCacheNegTtl(0),
+  mCache(0),
+  mHalfLife(3600),
+  mLatWeight(1.0),
+  mErrWeight(1.0),
+  mScopeEntries(4096),
+  mScopes(0),
+  mHintMode(eHintFirst),
+  mAsyncLocate(true),
+  mMetalink(false),
+  mFstRedirect(false),
+  mReplicaTtl(5),
+  mReplicaEntries(65536),
+  mReplicaHot(2),
+  mReplicas(0),
+  mNumProbes(0),
+  mNumStats(0),
+  mNumHedged(0),
+  mNumExpired(0),
+  mNumPingErrors(0),
+  mNumCoalesced(0),
+  mNumPredicted(0),
+  mNumMispredicted(0),
+  mNumAsync(0),
+  mNumPending(0),
+  mNumMetalink(0),
+  mNumAuthoritative(0),
+  mNumTried(0),
+  mNumTriedErased(0),
+  mNumHints(0),
+  mNumHintUnknown(0),
+  mNumHintProbes(0),
+  mNumHintHits(0),
+  mNumReplicaErrors(0),
+  mStopMaintenance(false),
+  mMaintenanceRunning(false)
 {
   RucioError.logger(logger);
 }
@@ -103,7 +233,22 @@ EosRucioCms::EosRucioCms(XrdSysLogger* logger):
 //------------------------------------------------------------------------------
 EosRucioCms::~EosRucioCms()
 {
-  //empty
+  if (mMaintenanceRunning)
+  {
+    mMaintenanceCond.Lock();
+    mStopMaintenance = true;
+    mMaintenanceCond.Signal();
+    mMaintenanceCond.UnLock();
+    XrdSysThread::Join(mMaintenanceTid, 0);
+  }
+
+  // The queued checks are shed and the probes still waiting for a timer are
+  // dropped before the EOS file system objects they use go away
+  mDispatcher.Stop();
+  mProbeTimer.Stop();
+  delete mScopes;
+  delete mCache;
+  delete mReplicas;
 }
 
 
@@ -118,6 +263,10 @@ EosRucioCms::Configure(const char* cfn, char* params, XrdOucEnv* EnvInfo)
   char* var;
   const char* val;
   std::string space_tkn;
+  // Routing rules are compiled once the space tokens are known
+  std::vector< std::pair<std::string, std::vector<std::string> > > routes;
+  std::vector< std::pair<std::string, unsigned int> > token_limits;
+  std::vector<std::string> authoritative;
 
   // Extract the manager from the config file
   XrdOucStream Config(&RucioError, getenv("XRDINSTANCE"));
@@ -250,6 +399,33 @@ EosRucioCms::Configure(const char* cfn, char* params, XrdOucEnv* EnvInfo)
           }
         }
 
+        // Get additional EOS endpoint i.e. host:port followed by parameters
+        option_tag = "eosendpoint";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No EOS endpoint specified");
+          else
+          {
+            std::string endpoint = val;
+            std::string host;
+            unsigned int port = 0;
+            unsigned int weight = 1;
+            EndpointSet::Role role = EndpointSet::ePrimary;
+            bool valid = ParseHostPort(option_tag.c_str(), val, host, port);
+
+            while ((val = Config.GetToken()))
+            {
+              if (!ParseEndpointParam(val, weight, role))
+                valid = false;
+            }
+
+            if (!valid || (mEosEndpoints.Add(host, port, weight, role) < 0))
+              RucioError.Emsg("Configure", "Ignore EOS endpoint", endpoint.c_str());
+          }
+        }
+
         // Get Rucio N2N uplink host address
         option_tag = "uphost";
 
@@ -290,331 +466,2657 @@ EosRucioCms::Configure(const char* cfn, char* params, XrdOucEnv* EnvInfo)
             }
           }
         }
-      }
-    }
+
+        // Get additional uplink i.e. host:port followed by parameters
+        option_tag = "upendpoint";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No uplink endpoint specified");
+          else
+          {
+            std::string endpoint = val;
+            std::string host;
+            unsigned int port = 0;
+            unsigned int weight = 1;
+            EndpointSet::Role role = EndpointSet::ePrimary;
+            bool valid = ParseHostPort(option_tag.c_str(), val, host, port);
+
+            while ((val = Config.GetToken()))
+            {
+              if (!ParseEndpointParam(val, weight, role))
+                valid = false;
+            }
+
+            if (!valid || (mUplinks.Add(host, port, weight, role) < 0))
+              RucioError.Emsg("Configure", "Ignore uplink endpoint",
+                              endpoint.c_str());
+          }
+        }
+
+        // Get the interval in seconds between pings to the uplinks
+        option_tag = "uppinginterval";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No uplink ping interval specified");
+          else if (ParseUnsigned(option_tag.c_str(), val, mUplinkPing) &&
+                   !mUplinkPing)
+          {
+            RucioError.Emsg("Configure", "Uplink ping interval must be > 0");
+            mUplinkPing = 10;
+          }
+        }
+
+        // Get the mode used to check the existence of files in EOS
+        option_tag = "probemode";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No probe mode specified");
+          else if (!strcmp(val, "sequential"))
+            mProbeMode = PfnProbe::eSequential;
+          else if (!strcmp(val, "parallel"))
+            mProbeMode = PfnProbe::eParallel;
+          else if (!strcmp(val, "hedged"))
+            mProbeMode = PfnProbe::eHedged;
+          else
+            RucioError.Emsg("Configure", "Unknown probe mode: ", val);
+        }
+
+        // Get whether the locate requests are answered through a callback
+        option_tag = "asynclocate";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No async locate value specified");
+          else if (!strcmp(val, "on"))
+            mAsyncLocate = true;
+          else if (!strcmp(val, "off"))
+            mAsyncLocate = false;
+          else
+            RucioError.Emsg("Configure", "Unknown async locate value: ", val);
+        }
+
+        // Get whether the files in EOS are answered with a metalink
+        option_tag = "metalink";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No metalink value specified");
+          else if (!strcmp(val, "on"))
+            mMetalink = true;
+          else if (!strcmp(val, "off"))
+            mMetalink = false;
+          else
+            RucioError.Emsg("Configure", "Unknown metalink value: ", val);
+        }
+
+        // Get whether the hot files are redirected to their storage node
+        option_tag = "fstredirect";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No FST redirect value specified");
+          else if (!strcmp(val, "on"))
+            mFstRedirect = true;
+          else if (!strcmp(val, "off"))
+            mFstRedirect = false;
+          else
+            RucioError.Emsg("Configure", "Unknown FST redirect value: ", val);
+        }
+
+        // Get the time to live of the replicas of a file
+        option_tag = "replicattl";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No replica ttl specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mReplicaTtl);
+        }
+
+        // Get the maximum number of files in the replica cache
+        option_tag = "replicacache";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No replica cache size specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mReplicaEntries);
+        }
+
+        // Get the number of locates of a file after which its replicas are
+        // fetched
+        option_tag = "replicahot";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No replica hotness specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mReplicaHot);
+        }
+
+        // Get the latency percentile after which a hedged stat is sent
+        option_tag = "hedgepercentile";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          unsigned int pct = 0;
+
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No hedge percentile specified");
+          else if (ParseUnsigned(option_tag.c_str(), val, pct))
+          {
+            if ((pct < 50) || (pct > 100))
+              RucioError.Emsg("Configure", "Hedge percentile must be in [50, 100]");
+            else
+              mHedgePct = pct;
+          }
+        }
+
+        // Get the interval in seconds between statistics reports
+        option_tag = "reportinterval";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No report interval specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mReportInterval);
+        }
+
+        // Get the time budget in milliseconds of the existence check
+        option_tag = "locatedeadline";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No locate deadline specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mLocateDeadline);
+        }
+
+        // Get the maximum number of existence checks in flight to EOS
+        option_tag = "maxchecks";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No maximum number of checks specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mMaxChecks);
+        }
+
+        // Get the maximum number of existence checks waiting for admission
+        option_tag = "queuesize";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No queue size specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mQueueSize);
+        }
+
+        // Get the maximum time in ms an existence check waits for admission
+        option_tag = "queuewait";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No queue wait specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mQueueWait);
+        }
+
+        // Get the interval in seconds between pings to the EOS instance
+        option_tag = "keepalive";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No keepalive interval specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mKeepAlive);
+        }
+
+        // Get the memory limit in MB of the existence cache
+        option_tag = "cachesize";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No cache size specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mCacheSize);
+        }
+
+        // Get the time to live in seconds of a cached file found in EOS
+        option_tag = "cachettl";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No cache ttl specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mCacheTtl);
+        }
+
+        // Get the time to live in seconds of a cached file not in EOS
+        option_tag = "cachenegttl";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No cache negative ttl specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mCacheNegTtl);
+        }
+
+        // Get the half life in seconds of the space token hits
+        option_tag = "halflife";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No half life specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mHalfLife);
+        }
+
+        // Get the weight of the stat latency in the space token score
+        option_tag = "latencyweight";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No latency weight specified");
+          else
+            ParseDouble(option_tag.c_str(), val, mLatWeight);
+        }
+
+        // Get the weight of the stat error rate in the space token score
+        option_tag = "errorweight";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No error weight specified");
+          else
+            ParseDouble(option_tag.c_str(), val, mErrWeight);
+        }
+
+        // Get the number of entries of the scope prediction table
+        option_tag = "scopetable";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No scope table size specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mScopeEntries);
+        }
+
+        // Get the limit of outstanding stats of all or some space tokens
+        option_tag = "tokenlimit";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          unsigned int limit = 0;
+
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No token limit specified");
+          else if (ParseUnsigned(option_tag.c_str(), val, limit))
+          {
+            bool all = true;
+
+            while ((val = Config.GetToken()))
+            {
+              // Add a slash at the end if there is none already
+              space_tkn = val;
+
+              if (space_tkn.at(space_tkn.length() - 1) != '/')
+                space_tkn += '/';
+
+              token_limits.push_back(std::make_pair(space_tkn, limit));
+              all = false;
+            }
+
+            if (all)
+              mTokenLimit = limit;
+          }
+        }
+
+        // Get the space tokens known to hold all the files mapped to them
+        option_tag = "authoritative";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No authoritative space token specified");
+
+          for (; val; val = Config.GetToken())
+          {
+            // Add a slash at the end if there is none already
+            space_tkn = val;
+
+            if (space_tkn.at(space_tkn.length() - 1) != '/')
+              space_tkn += '/';
+
+            authoritative.push_back(space_tkn);
+          }
+        }
+
+        // Get how the space token hint of the clients is used
+        option_tag = "tokenhint";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No token hint mode specified");
+          else if (!strcmp(val, "off"))
+            mHintMode = eHintOff;
+          else if (!strcmp(val, "first"))
+            mHintMode = eHintFirst;
+          else if (!strcmp(val, "only"))
+            mHintMode = eHintOnly;
+          else
+            RucioError.Emsg("Configure", "Unknown token hint mode: ", val);
+        }
+
+        // Get the consecutive failed checks which open the circuit breaker
+        option_tag = "breakerfailures";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No breaker failures specified");
+          else
+            ParseUnsigned(option_tag.c_str(), val, mBreakerFailures);
+        }
+
+        // Get the seconds the circuit breaker stays open before a trial
+        option_tag = "breakeropen";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No breaker open interval specified");
+          else if (ParseUnsigned(option_tag.c_str(), val, mBreakerOpen) &&
+                   !mBreakerOpen)
+          {
+            RucioError.Emsg("Configure", "Breaker open interval must be > 0");
+            mBreakerOpen = 10;
+          }
+        }
+
+        // Get the path stated periodically to monitor the EOS instance
+        option_tag = "canarypath";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No canary path specified");
+          else
+            mCanaryPath = val;
+        }
+
+        // Get the interval in seconds between canary stats
+        option_tag = "canaryinterval";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetWord()))
+            RucioError.Emsg("Configure ", "No canary interval specified");
+          else if (ParseUnsigned(option_tag.c_str(), val, mCanaryInterval) &&
+                   !mCanaryInterval)
+          {
+            RucioError.Emsg("Configure", "Canary interval must be > 0");
+            mCanaryInterval = 5;
+          }
+        }
+
+        // Get QoS class i.e. name, limits and conditions on the client
+        option_tag = "qos";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No QoS class name specified");
+          else
+          {
+            std::string name = val;
+            QosTable::Limits limits;
+            std::vector<QosTable::Match> matches;
+            bool valid = true;
+
+            while ((val = Config.GetToken()))
+            {
+              if (!ParseQosParam(val, limits, matches))
+                valid = false;
+            }
+
+            if (valid)
+              mQos.AddClass(name, matches, limits);
+            else
+              RucioError.Emsg("Configure", "Ignore QoS class", name.c_str());
+          }
+        }
+
+        // Get static routing rule i.e. scope prefix and space tokens
+        option_tag = "route";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            RucioError.Emsg("Configure ", "No route scope prefix specified");
+          else
+          {
+            std::string prefix = val;
+            std::vector<std::string> tokens;
+
+            // The prefix matches any scope starting with it
+            if (!prefix.empty() && (prefix.at(prefix.length() - 1) == '*'))
+              prefix.erase(prefix.length() - 1);
+
+            while ((val = Config.GetToken()))
+            {
+              // Add a slash at the end if there is none already
+              space_tkn = val;
+
+              if ((space_tkn != "*") &&
+                  (space_tkn.at(space_tkn.length() - 1) != '/'))
+                space_tkn += '/';
+
+              tokens.push_back(space_tkn);
+            }
+
+            if (tokens.empty())
+              RucioError.Emsg("Configure", "No space tokens for route",
+                              prefix.c_str());
+            else
+              routes.push_back(std::make_pair(prefix, tokens));
+          }
+        }
+      }
+    }
+  }
+
+  // The eoshost and eosport pair is a primary endpoint like the ones given
+  // with eosendpoint
+  if (!mEosHost.empty() && mEosPort &&
+      (mEosEndpoints.Add(mEosHost, mEosPort, 1, EndpointSet::ePrimary) < 0))
+  {
+    RucioError.Emsg("Configure ", "EOS redirect url is not valid");
+    success = 0;
+  }
+
+  // Check that there is at least one EOS endpoint
+  if (!mEosEndpoints.GetSize())
+  {
+    RucioError.Emsg("Configure", "EOS redirect instance value missing/invalid",
+                    "Example \"eosrucio.eoshost eosatlas.cern.ch\"",
+                    "        \"eosrucio.eosport 1094\"");
+    success = 0;
+    return success;
+  }
+
+  for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
+  {
+    EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(i);
+    std::ostringstream oss;
+    oss << endpoint.instance << " role=" << EndpointSet::GetRoleName(endpoint.role)
+        << " weight=" << endpoint.weight;
+    RucioError.Say("EosRucioCms::Configure ", "EOS endpoint: ", oss.str().c_str());
+  }
+
+  // The uphost and upport pair is a primary uplink like the ones given with
+  // upendpoint
+  if (!mUplinkHost.empty() && mUplinkPort &&
+      (mUplinks.Add(mUplinkHost, mUplinkPort, 1, EndpointSet::ePrimary) < 0))
+  {
+    RucioError.Emsg("Configure ", "Uplink redirect url is not valid");
+    success = 0;
+  }
+
+  // Check that there is at least one uplink
+  if (!mUplinks.GetSize())
+  {
+    RucioError.Emsg("Configure", "Uplink instance value missing/invalid",
+                    "Example \"eosrucio.uphost atlas-xrd-eu.cern.ch\"",
+                    "        \"eosrucio.upport 1094\"");
+    success = 0;
+    return success;
+  }
+
+  for (size_t i = 0; i < mUplinks.GetSize(); ++i)
+  {
+    EndpointSet::Endpoint& uplink = mUplinks.Get(i);
+    std::ostringstream oss;
+    oss << uplink.instance << " role=" << EndpointSet::GetRoleName(uplink.role)
+        << " weight=" << uplink.weight;
+    RucioError.Say("EosRucioCms::Configure ", "Uplink endpoint: ", oss.str().c_str());
+  }
+
+  // An uplink is excluded after two pings without reply and pinged again as
+  // the trial once its open interval is over
+  mUplinks.Configure(2, static_cast<uint64_t>(mUplinkPing) * 1000000,
+                     static_cast<uint64_t>(mUplinkPing) * 8000000);
+
+  // Check that the Rucio site name was specified
+  if (mSiteName.empty())
+  {
+    RucioError.Emsg("Configure", "Mandatory site name value missing.",
+                    "Example \"eosrucio.site CERN-EOS\"");
+    success = 0;
+    return success;
+  }
+
+  RucioError.Say("EosRucioCms::Configure ", "Json file: ", mJsonFile.c_str());
+  RucioError.Say("EosRucioCms::Configure ", "AGIS site: ", mAgisSite.c_str());
+  RucioError.Say("EosRucioCms::Configure ", "Site: ", mSiteName.c_str());
+  RucioError.Say("EosRucioCms::Configure ", "Probe mode: ",
+                 (mProbeMode == PfnProbe::eParallel ? "parallel" :
+                  (mProbeMode == PfnProbe::eHedged ? "hedged" : "sequential")));
+  RucioError.Say("EosRucioCms::Configure ", "Async locate: ",
+                 (mAsyncLocate ? "on" : "off"));
+  RucioError.Say("EosRucioCms::Configure ", "Metalink: ",
+                 (mMetalink ? "on" : "off"));
+
+  if (mLocateDeadline)
+  {
+    std::ostringstream oss;
+    oss << mLocateDeadline << " ms";
+    RucioError.Say("EosRucioCms::Configure ", "Locate deadline: ", oss.str().c_str());
+  }
+
+  // After failed trials a breaker stays open up to 8 times longer
+  mEosEndpoints.Configure(mBreakerFailures,
+                          static_cast<uint64_t>(mBreakerOpen) * 1000000,
+                          static_cast<uint64_t>(mBreakerOpen) * 8000000);
+
+  if (mBreakerFailures || !mCanaryPath.empty())
+  {
+    std::ostringstream oss;
+    oss << "failures=" << mBreakerFailures << " open=" << mBreakerOpen << "s";
+
+    if (!mCanaryPath.empty())
+      oss << " canary=" << mCanaryPath << " every " << mCanaryInterval << "s";
+
+    RucioError.Say("EosRucioCms::Configure ", "Circuit breaker: ", oss.str().c_str());
+  }
+
+  if (mMapSpace.empty())
+  {
+    bool done_agis = false;
+    bool done_json = false;
+
+    // This means that the overwriteSE tag did not specify any tokens, therefore
+    // we need first to check the AGIS site and then the local JSON file
+    if (!mAgisSite.empty())
+    {
+      // Try to read configuration of space tokens from the AGIS site
+      RucioError.Say("Configure: ", "Trying to read config from AGIS site");
+      done_agis = ReadAgisConfig();
+    }
+
+    if (!done_agis && !mJsonFile.empty())
+    {
+      // Try to read configuration of space tokens from the json file
+      RucioError.Say("Configure: ", "Trying to read config from JSON file");
+      done_json = ReadLocalJson(mJsonFile);
+    }
+
+    if (!done_agis && !done_json)
+    {
+      RucioError.Emsg("Configure",
+                      "No resource (overwriteSE, AGIS site or local (JSON file)) from",
+                      "which to read the space tokend is available");
+      success = 0;
+    }
+  }
+
+  // Check that we have some mappings defined
+  if (mMapSpace.empty())
+  {
+    RucioError.Emsg("Configure", "The Rucio space token map is empty");
+    success = 0;
+  }
+
+  RucioError.Emsg("Configure", "Contents of the space tokens map is:");
+  std::stringstream ss;
+
+  mTokens.SetScoring(mHalfLife, mLatWeight, mErrWeight);
+  mTokens.Init(mMapSpace);
+
+  // Each space token gets its own limit of outstanding stats so that a slow
+  // one can not hold all the existence checks
+  for (size_t i = 0; i < mTokens.Size(); ++i)
+    mTokens.GetBulkhead(i)->SetLimit(mTokenLimit);
+
+  for (auto it = token_limits.begin(); it != token_limits.end(); ++it)
+  {
+    int index = mTokens.GetIndex(it->first);
+
+    if (index < 0)
+      RucioError.Emsg("Configure", "Unknown space token in tokenlimit",
+                      it->first.c_str());
+    else
+      mTokens.GetBulkhead(index)->SetLimit(it->second);
+  }
+
+  // The files whose first space token to probe is authoritative are
+  // redirected there without being stated
+  for (auto it = authoritative.begin(); it != authoritative.end(); ++it)
+  {
+    int index = mTokens.GetIndex(*it);
+
+    if (index < 0)
+    {
+      RucioError.Emsg("Configure", "Unknown space token in authoritative",
+                      it->c_str());
+    }
+    else
+    {
+      mAuthoritative.resize(mTokens.Size(), false);
+      mAuthoritative[index] = true;
+      RucioError.Say("EosRucioCms::Configure ", "Authoritative space token: ",
+                     it->c_str());
+    }
+  }
+
+  // The clients name a space token by its path or by its last component,
+  // which is only accepted if no other space token ends with it
+  std::map<std::string, int> short_names;
+
+  for (size_t i = 0; (mHintMode != eHintOff) && (i < mTokens.Size()); ++i)
+  {
+    std::string name = mTokens.GetName(i);
+    mHintTokens[name] = i;
+    name.erase(name.length() - 1);
+    mHintTokens[name] = i;
+    name.erase(0, name.rfind('/') + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    if (name.empty())
+      continue;
+
+    auto it = short_names.find(name);
+
+    if (it == short_names.end())
+      short_names[name] = i;
+    else
+      it->second = -1;
+  }
+
+  for (auto it = short_names.begin(); it != short_names.end(); ++it)
+  {
+    if (it->second >= 0)
+      mHintTokens[it->first] = it->second;
+    else
+      RucioError.Emsg("Configure", "Ambiguous space token hint, only the full "
+                      "path is accepted for", it->first.c_str());
+  }
+
+  TokenTable::SnapshotRef snapshot(mTokens);
+
+  for (auto it = snapshot->order.begin(); it != snapshot->order.end(); ++it)
+  {
+    ss << snapshot->priority[*it] << " score=" << snapshot->score[*it];
+    RucioError.Say(mTokens.GetName(*it).c_str(), " " , ss.str().c_str());
+    ss.str("");
+  }
+
+  ss << "half_life=" << mHalfLife << "s latency_weight=" << mLatWeight
+     << "/ms error_weight=" << mErrWeight;
+  RucioError.Say("EosRucioCms::Configure ", "Token scoring: ", ss.str().c_str());
+  ss.str("");
+
+  // The clients matching no class are not limited
+  mQos.Init(mMaxChecks);
+
+  for (size_t i = 0; i < mQos.GetNumClasses(); ++i)
+  {
+    const QosTable::Class& cls = mQos.GetClass(i);
+    ss << "rate=" << cls.limits.rate << "/s client_rate=" << cls.limits.client_rate
+       << "/s max_in_flight=" << cls.max_in_flight << " conditions="
+       << cls.matches.size();
+    RucioError.Say("EosRucioCms::Configure QoS class: ", cls.name.c_str(), " ",
+                   ss.str().c_str());
+    ss.str("");
+  }
+
+  // Compile the routing rules, a "*" token means that the other space tokens
+  // are probed afterwards
+  for (auto it = routes.begin(); it != routes.end(); ++it)
+  {
+    std::vector<int> tokens;
+    bool others = false;
+
+    for (auto iter_tkn = it->second.begin(); iter_tkn != it->second.end();
+         ++iter_tkn)
+    {
+      int index = mTokens.GetIndex(*iter_tkn);
+
+      if (*iter_tkn == "*")
+        others = true;
+      else if (index < 0)
+        RucioError.Emsg("Configure", "Unknown space token in route",
+                        it->first.c_str(), iter_tkn->c_str());
+      else
+        tokens.push_back(index);
+    }
+
+    if (tokens.empty())
+    {
+      RucioError.Emsg("Configure", "Ignore route without valid space tokens",
+                      it->first.c_str());
+      continue;
+    }
+
+    mRoutes.AddRule(it->first, tokens, others);
+    ss << "scope=" << it->first << "*";
+
+    for (auto iter_idx = tokens.begin(); iter_idx != tokens.end(); ++iter_idx)
+      ss << " " << mTokens.GetName(*iter_idx);
+
+    if (others)
+      ss << " *";
+
+    RucioError.Say("EosRucioCms::Configure ", "Route: ", ss.str().c_str());
+    ss.str("");
+  }
+
+  if (mScopeEntries)
+  {
+    mScopes = new ScopeTable(mScopeEntries);
+    ss << "entries=" << mScopes->GetCapacity();
+    RucioError.Say("EosRucioCms::Configure ", "Scope prediction: ", ss.str().c_str());
+    ss.str("");
+  }
+
+  if (mCacheSize && (mCacheTtl || mCacheNegTtl))
+  {
+    mCache = new PfnCache(static_cast<size_t>(mCacheSize) << 20,
+                          static_cast<uint64_t>(mCacheTtl) * 1000000,
+                          static_cast<uint64_t>(mCacheNegTtl) * 1000000);
+    PfnCache::Stats stats;
+    mCache->GetStats(stats);
+    ss << "size=" << mCacheSize << "MB entries=" << stats.capacity
+       << " ttl=" << mCacheTtl << "s neg_ttl=" << mCacheNegTtl << "s";
+    RucioError.Say("EosRucioCms::Configure ", "Existence cache: ", ss.str().c_str());
+    ss.str("");
+  }
+
+  if (mFstRedirect && mReplicaTtl && mReplicaEntries)
+  {
+    mReplicas = new ReplicaCache(mReplicaEntries,
+                                 static_cast<uint64_t>(mReplicaTtl) * 1000000,
+                                 mReplicaHot);
+    ss << "entries=" << mReplicaEntries << " ttl=" << mReplicaTtl << "s"
+       << " hot=" << mReplicaHot;
+    RucioError.Say("EosRucioCms::Configure ", "FST redirect: ", ss.str().c_str());
+    ss.str("");
+  }
+
+  if (success)
+  {
+    // Connect to EOS now so that the first requests do not pay for it. A
+    // failure is not fatal since the connection is retried on demand.
+    if (PingEos())
+      RucioError.Say("EosRucioCms::Configure ", "Connected to the EOS endpoints");
+
+    // The round trip times of the uplinks are known before the first misses
+    if (mUplinks.GetSize() > 1)
+      PingUplinks();
+
+    if (XrdSysThread::Run(&mMaintenanceTid, EosRucioCms::StartMaintenance,
+                          static_cast<void*>(this), XRDSYSTHREAD_HOLD,
+                          "EosRucioCms maintenance"))
+    {
+      RucioError.Emsg("Configure", "Failed to start the maintenance thread");
+      success = 0;
+    }
+    else
+    {
+      mMaintenanceRunning = true;
+    }
+
+    // Beyond the limit the checks wait in a bounded queue and the locates
+    // which can not be admitted in time are redirected to the uplink
+    if (mDispatcher.Start(mMaxChecks, mQueueSize,
+                          static_cast<uint64_t>(mQueueWait) * 1000))
+    {
+      if (mMaxChecks)
+      {
+        ss << "max_checks=" << mMaxChecks << " queue=" << mQueueSize
+           << " wait=" << mQueueWait << "ms";
+        RucioError.Say("EosRucioCms::Configure ", "Stat dispatcher: ",
+                       ss.str().c_str());
+        ss.str("");
+      }
+    }
+    else
+    {
+      RucioError.Emsg("Configure", "Failed to start the stat dispatcher thread, "
+                      "existence checks are not limited");
+    }
+
+    // Without the timer thread the hedge delays and deadlines of the
+    // asynchronous probes would never fire
+    if (mAsyncLocate && !mProbeTimer.Start())
+    {
+      RucioError.Emsg("Configure", "Failed to start the probe timer thread, "
+                      "locate requests are served synchronously");
+      mAsyncLocate = false;
+    }
+  }
+
+  return success;
+}
+
+
+//------------------------------------------------------------------------------
+// Locate
+//------------------------------------------------------------------------------
+int
+EosRucioCms::Locate(XrdOucErrInfo& Resp,
+                    const char* path,
+                    int flags,
+                    XrdOucEnv* Info)
+{
+  // Get identity of the caller
+  XrdSecEntity* sec_entity = NULL;
+
+  if (Info)
+  {
+    sec_entity = const_cast<XrdSecEntity*>(Info->secEnv());
+
+    if (!sec_entity)
+    {
+      sec_entity = new XrdSecEntity("");
+      sec_entity->tident = new char[16];
+      sec_entity->tident = strncpy(sec_entity->tident, "unknown", 7);
+    }
+  }
+
+  const char* tident = (sec_entity ? sec_entity->tident : "unknown");
+  bool refresh = (flags & SFS_O_RESET);
+  SingleFlight::Result result;
+  // The QoS class of the client limits the existence checks it can trigger
+  int qos = mQos.Classify(sec_entity);
+  uint32_t client = (qos >= 0 ? QosTable::HashClient(sec_entity) : 0);
+  // Only the clients accepting a URL as redirection can follow a metalink and
+  // the Ofs plugin expects the host of the redirection
+  bool metalink = (mMetalink && !(flags & SFS_O_STAT) &&
+                   (Resp.getUCap() & XrdOucEI::uUrlOK));
+  // The storage nodes only serve the files opened for reading
+  bool direct = (mReplicas && !(flags & (SFS_O_STAT | SFS_O_WRONLY |
+                                         SFS_O_RDWR | SFS_O_CREAT |
+                                         SFS_O_TRUNC)));
+  // The client may know the space token holding the file
+  const char* hint_val = ((Info && (mHintMode != eHintOff)) ?
+                          Info->Get("eosrucio.token") : 0);
+  int hint = -1;
+
+  if (hint_val)
+  {
+    hint = GetHintToken(hint_val);
+
+    if (hint >= 0)
+      mNumHints++;
+    else
+      mNumHintUnknown++;
+  }
+
+  // A client which failed in EOS goes to the uplink without a new check so
+  // that it is not sent back to the same place
+  const char* tried = (Info ? Info->Get("tried") : 0);
+
+  if (tried && IsEosTried(tried, path))
+  {
+    DropTried(path, tident, Info->Get("triedrc"));
+  }
+  // Compute the Rucio pfn using the algorithm and redirect to the correct
+  // location - this also stats the file in EOS. When the client can wait for
+  // a callback, the thread is released while the stat requests are in flight.
+  // The stat done by the Ofs plugin needs the answer right away.
+  else if (mAsyncLocate && !(flags & SFS_O_STAT) &&
+           XrdOucCallBack::Allowed(&Resp))
+  {
+    AsyncLocate* request = new AsyncLocate(this, path, tident, metalink,
+                                           direct);
+    request->mCheck.qos = qos;
+    request->mCheck.client = client;
+    request->mCheck.hint = hint;
+    CheckState state = BeginCheck(request->mCheck, path, refresh, result);
+
+    if (state != eCheckDone)
+    {
+      if (request->mCallBack.Init(&Resp))
+      {
+        mNumAsync++;
+        mNumPending++;
+
+        if (state == eCheckFollow)
+          mInFlight.Wait(request->mCheck.flight, request);
+        else
+          request->Dispatch();
+
+        return SFS_STARTED;
+      }
+
+      result = WaitCheck(request->mCheck, state);
+    }
+
+    delete request;
+  }
+  else
+  {
+    // The stat done by the Ofs plugin checks the file even in an
+    // authoritative space token
+    result = GetValidPfn(path, refresh, qos, client, (flags & SFS_O_STAT),
+                         hint);
+  }
+
+  std::string target;
+  int code = 0;
+  int retc = GetResponse(path, result, tident, metalink, direct, target,
+                         code);
+
+  if (retc == SFS_DATA)
+  {
+    Resp.setErrData(0);
+    return SFS_DATA;
+  }
+
+  // The stat of the Ofs plugin fills its answer with the metadata of the file
+  // in EOS, sparing the client a stat of its own
+  if ((flags & SFS_O_STAT) && result.has_stat)
+  {
+    char buf[160];
+    unsigned long long size = result.size;
+    unsigned long long mtime = result.mtime;
+    unsigned long long ino = result.ino;
+    unsigned int sflags = result.flags;
+    snprintf(buf, sizeof(buf), "&eosrucio.size=%llu&eosrucio.mtime=%llu"
+             "&eosrucio.flags=%u&eosrucio.ino=%llu", size, mtime, sflags, ino);
+    target += buf;
+  }
+
+  Resp.setErrCode(code);
+  Resp.setErrData(target.c_str());
+  return SFS_REDIRECT;
+}
+
+
+//------------------------------------------------------------------------------
+// Build the response of a locate
+//------------------------------------------------------------------------------
+int
+EosRucioCms::GetResponse(const char* path, const SingleFlight::Result& result,
+                         const char* tident, bool metalink, bool direct,
+                         std::string& target, int& code)
+{
+  // The client goes to the EOS endpoint which confirmed the file or, for the
+  // hot files, straight to a storage node holding it
+  if (!result.pfn.empty() && (result.endpoint >= 0))
+  {
+    EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(result.endpoint);
+    ReplicaCache::Replica replica;
+    const std::string* host = &endpoint.host;
+    int port = endpoint.port;
+
+    if (direct && GetReplica(result, replica))
+    {
+      host = &replica.host;
+      port = replica.port;
+    }
+
+    // The metalink is written in a buffer of the thread sized for the
+    // largest response, it falls back to a plain redirection if too long
+    size_t len = (metalink ? BuildMetalink(path, result.pfn, *host, port,
+                                           sMetalinkBuf, sizeof(sMetalinkBuf))
+                  : 0);
+
+    if (len)
+    {
+      mNumMetalink++;
+      target.assign(sMetalinkBuf, len);
+      code = -1;
+      return SFS_REDIRECT;
+    }
+
+    target = *host;
+    target += "?eos.lfn=";
+    target += result.pfn;
+    target += "&eos.app=lfc";
+    code = port;
+    return SFS_REDIRECT;
+  }
+
+  if ((strcmp(path, "/atlas") == 0))
+  {
+    RucioError.Emsg("Locate", tident, "for \"/atlas\" we return OK");
+    target = "";
+    code = 0;
+    return SFS_DATA;
+  }
+
+  // The misses go to the healthy uplinks, the fastest ones more often
+  RucioError.Emsg("Locate", tident,
+                  "error=pfn not found, redirect to uplink_mgr for lfn=", path);
+  EndpointSet::Endpoint& uplink = mUplinks.Get(mUplinks.PickByRtt());
+  target = uplink.host;
+  code = uplink.port;
+  return SFS_REDIRECT;
+}
+
+
+//------------------------------------------------------------------------------
+// Get a storage node holding a replica of a file found in EOS
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::GetReplica(const SingleFlight::Result& result,
+                        ReplicaCache::Replica& replica)
+{
+  bool fetch = false;
+
+  if (mReplicas->Get(result.pfn, replica, fetch))
+    return true;
+
+  // Only the locate making the file hot asks for its replicas, the response
+  // is not waited for since the file may never be requested again
+  if (fetch)
+  {
+    EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(result.endpoint);
+    ReplicaLocateHandler* handler = new ReplicaLocateHandler(this, result.pfn);
+    XrdCl::XRootDStatus st = endpoint.fs->Locate(result.pfn,
+                             XrdCl::OpenFlags::None, handler, 5);
+
+    // If the request could not be sent the handler is never called
+    if (!st.IsOK())
+      handler->HandleResponse(new XrdCl::XRootDStatus(st), 0);
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Build the metalink of a file found in EOS
+//------------------------------------------------------------------------------
+size_t
+EosRucioCms::BuildMetalink(const char* path, const std::string& pfn,
+                           const std::string& host, int port, char* buf,
+                           size_t size)
+{
+  static const char head[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                             "<metalink xmlns=\"urn:ietf:params:xml:ns:metalink\">"
+                             "<file name=\"";
+  static const char eos_url[] = "\"><url priority=\"1\">root://";
+  static const char eos_opaque[] = "?eos.lfn=";
+  static const char eos_app[] = "&amp;eos.app=lfc";
+  static const char up_url[] = "</url><url priority=\"2\">root://";
+  static const char tail[] = "</url></file></metalink>";
+  const char* name = strrchr(path, '/');
+  char port_str[16];
+  int port_len = snprintf(port_str, sizeof(port_str), ":%d", port);
+  EndpointSet::Endpoint& uplink = mUplinks.Get(mUplinks.PickByRtt());
+  size_t len = 0;
+  // Keep room for the terminating null character
+  size--;
+
+  if (AppendBuf(buf, size, len, head, sizeof(head) - 1) &&
+      AppendXml(buf, size, len, (name ? name + 1 : path)) &&
+      AppendBuf(buf, size, len, eos_url, sizeof(eos_url) - 1) &&
+      AppendBuf(buf, size, len, host.c_str(), host.length()) &&
+      AppendBuf(buf, size, len, port_str, port_len) &&
+      AppendBuf(buf, size, len, "/", 1) &&
+      AppendXml(buf, size, len, path) &&
+      AppendBuf(buf, size, len, eos_opaque, sizeof(eos_opaque) - 1) &&
+      AppendXml(buf, size, len, pfn.c_str()) &&
+      AppendBuf(buf, size, len, eos_app, sizeof(eos_app) - 1) &&
+      AppendBuf(buf, size, len, up_url, sizeof(up_url) - 1) &&
+      AppendBuf(buf, size, len, uplink.instance.c_str(),
+                uplink.instance.length()) &&
+      AppendBuf(buf, size, len, "/", 1) &&
+      AppendXml(buf, size, len, path) &&
+      AppendBuf(buf, size, len, tail, sizeof(tail) - 1))
+  {
+    buf[len] = '\0';
+    return len;
+  }
+
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Append data to a bounded buffer
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::AppendBuf(char* buf, size_t size, size_t& len, const char* data,
+                       size_t data_len)
+{
+  if (data_len > size - len)
+    return false;
+
+  memcpy(buf + len, data, data_len);
+  len += data_len;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Append a string to an XML document escaping the special characters
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::AppendXml(char* buf, size_t size, size_t& len, const char* data)
+{
+  // The paths rarely hold special characters, copy the runs between them
+  while (true)
+  {
+    size_t run = strcspn(data, "&<>\"'");
+
+    if (!AppendBuf(buf, size, len, data, run))
+      return false;
+
+    data += run;
+    const char* entity;
+
+    switch (*data)
+    {
+    case '\0':
+      return true;
+
+    case '&':
+      entity = "&amp;";
+      break;
+
+    case '<':
+      entity = "&lt;";
+      break;
+
+    case '>':
+      entity = "&gt;";
+      break;
+
+    case '"':
+      entity = "&quot;";
+      break;
+
+    default:
+      entity = "&apos;";
+      break;
+    }
+
+    if (!AppendBuf(buf, size, len, entity, strlen(entity)))
+      return false;
+
+    ++data;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Translate logical file name to physical file name using the Rucio alg. This
+// is the allocation-free kernel used on the Locate path.
+//------------------------------------------------------------------------------
+int
+EosRucioCms::Translate(const char* lfn, size_t lfn_len, RucioName& rname,
+                       char* pfn, size_t pfn_size)
+{
+  static const char prefix[] = "/atlas/rucio/";
+  static const size_t prefix_len = sizeof(prefix) - 1;
+
+  // We only translate file names that begin with /atlas/rucio/
+  if ((lfn_len < prefix_len) || memcmp(lfn, prefix, prefix_len))
+    return eNotRucio;
+
+  const char* tmp = lfn + prefix_len;
+  size_t tmp_len = lfn_len - prefix_len;
+  const char* sep = static_cast<const char*>(memrchr(tmp, ':', tmp_len));
+
+  if (!sep)
+    sep = static_cast<const char*>(memrchr(tmp, '/', tmp_len));
+
+  if (sep)
+  {
+    rname.scope = tmp;
+    rname.scope_len = sep - tmp;
+    rname.name = sep + 1;
+    rname.name_len = tmp_len - rname.scope_len - 1;
+  }
+  else
+  {
+    // No separator at all, the whole string is used both as scope and name
+    rname.scope = rname.name = tmp;
+    rname.scope_len = rname.name_len = tmp_len;
+  }
+
+  if (!rname.name_len || !rname.scope_len)
+    return eNoScope;
+
+  // Layout is: rucio/<scope>/<hex0>/<hex1>/<name>
+  if (13 + rname.scope_len + rname.name_len >= pfn_size)
+    return eTooLong;
+
+  // Compute the MD5 hash of "scope:name" without building the string
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+  MD5_Update(&ctx, rname.scope, rname.scope_len);
+  MD5_Update(&ctx, ":", 1);
+  MD5_Update(&ctx, rname.name, rname.name_len);
+  MD5_Final(rname.digest, &ctx);
+  return FormatPfn(rname, pfn, pfn_size);
+}
+
+
+//------------------------------------------------------------------------------
+// Write the pfn corresponding to a Rucio name with an already computed digest
+//------------------------------------------------------------------------------
+int
+EosRucioCms::FormatPfn(const RucioName& rname, char* pfn, size_t pfn_size)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  size_t len = 13 + rname.scope_len + rname.name_len;
+
+  if (len >= pfn_size)
+    return eTooLong;
+
+  // Only the first two bytes of the digest are used in the path
+  char* ptr = pfn;
+  memcpy(ptr, "rucio/", 6);
+  ptr += 6;
+  memcpy(ptr, rname.scope, rname.scope_len);
+  ptr += rname.scope_len;
+  *ptr++ = '/';
+  *ptr++ = hex_digits[rname.digest[0] >> 4];
+  *ptr++ = hex_digits[rname.digest[0] & 0x0f];
+  *ptr++ = '/';
+  *ptr++ = hex_digits[rname.digest[1] >> 4];
+  *ptr++ = hex_digits[rname.digest[1] & 0x0f];
+  *ptr++ = '/';
+  memcpy(ptr, rname.name, rname.name_len);
+  ptr += rname.name_len;
+  *ptr = '\0';
+  return static_cast<int>(len);
+}
+
+
+//------------------------------------------------------------------------------
+// Translate logical file name to physical file name using the Rucio alg.
+//------------------------------------------------------------------------------
+std::string
+EosRucioCms::Translate(std::string lfn)
+{
+  RucioName rname;
+  char pfn[sPfnMaxLen];
+  int retc = Translate(lfn.c_str(), lfn.length(), rname, pfn, sizeof(pfn));
+
+  if (retc < 0)
+  {
+    LogTranslateError(retc);
+    return std::string("");
+  }
+
+  return std::string(pfn, retc);
+}
+
+
+//------------------------------------------------------------------------------
+// Translate a list of Rucio keys to physical file names in one pass
+//------------------------------------------------------------------------------
+size_t
+EosRucioCms::TranslateBatch(const std::vector<std::string>& keys,
+                            std::vector<std::string>& pfns)
+{
+  static const size_t chunk = 64;
+  const unsigned char* msgs[chunk];
+  size_t lens[chunk];
+  unsigned char digests[chunk][MD5_DIGEST_LENGTH];
+  char pfn[sPfnMaxLen];
+  RucioName rname;
+  size_t num_ok = 0;
+  pfns.resize(keys.size());
+
+  for (size_t pos = 0; pos < keys.size(); pos += chunk)
+  {
+    size_t count = ((keys.size() - pos < chunk) ? (keys.size() - pos) : chunk);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      msgs[i] = reinterpret_cast<const unsigned char*>(keys[pos + i].c_str());
+      lens[i] = keys[pos + i].length();
+    }
+
+    RucioMd5::Digest(msgs, lens, count, digests);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      // The file name never contains a colon, so the last one is the separator
+      const std::string& key = keys[pos + i];
+      size_t colon = key.rfind(':');
+      pfns[pos + i].clear();
+
+      if ((colon == std::string::npos) || (colon == 0) ||
+          (colon == key.length() - 1))
+        continue;
+
+      rname.scope = key.c_str();
+      rname.scope_len = colon;
+      rname.name = key.c_str() + colon + 1;
+      rname.name_len = key.length() - colon - 1;
+      memcpy(rname.digest, digests[i], MD5_DIGEST_LENGTH);
+      int len = FormatPfn(rname, pfn, sizeof(pfn));
+
+      if (len > 0)
+      {
+        pfns[pos + i].assign(pfn, len);
+        ++num_ok;
+      }
+    }
+  }
+
+  return num_ok;
+}
+
+
+//------------------------------------------------------------------------------
+// Log the reason for which the translation kernel failed
+//------------------------------------------------------------------------------
+void
+EosRucioCms::LogTranslateError(int retc)
+{
+  if (retc == eNotRucio)
+    RucioError.Emsg("Translate ", "File is not Rucio type");
+  else if (retc == eNoScope)
+    RucioError.Emsg("Translate", "Error extracting scope and/or file name");
+  else if (retc == eTooLong)
+    RucioError.Emsg("Translate", "Translated pfn exceeds the maximum length");
+}
+
+
+//------------------------------------------------------------------------------
+// Generate the full pfn path by concatenating the space tokens at the current
+// site with the translated lfn
+//------------------------------------------------------------------------------
+SingleFlight::Result
+EosRucioCms::GetValidPfn(std::string lfn, bool refresh, int qos,
+                         uint32_t client, bool verify, int hint)
+{
+  PfnCheck check;
+  check.qos = qos;
+  check.client = client;
+  check.verify = verify;
+  check.hint = hint;
+  SingleFlight::Result result;
+  CheckState state = BeginCheck(check, lfn.c_str(), refresh, result);
+
+  if (state != eCheckDone)
+    result = WaitCheck(check, state);
+
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if a client already tried an EOS endpoint
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::IsEosTried(const char* tried, const char* lfn)
+{
+  for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
+  {
+    if (IsHostTried(tried, mEosEndpoints.Get(i).host))
+      return true;
+  }
+
+  if (!mReplicas)
+    return false;
+
+  // The client may have been sent straight to the storage nodes of the file
+  RucioName rname;
+  char pfn_partial[sPfnMaxLen];
+
+  if (Translate(lfn, strlen(lfn), rname, pfn_partial, sizeof(pfn_partial)) < 0)
+    return false;
+
+  std::vector<ReplicaCache::Replica> replicas;
+
+  for (size_t i = 0; i < mTokens.Size(); ++i)
+  {
+    if (!mReplicas->GetReplicas(mTokens.GetName(i) + pfn_partial, replicas))
+      continue;
+
+    for (auto it = replicas.begin(); it != replicas.end(); ++it)
+    {
+      if (IsHostTried(tried, it->host))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if a host is in the tried list of a client
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::IsHostTried(const char* tried, const std::string& host)
+{
+  const char* name = tried;
+
+  while (*name)
+  {
+    const char* end = strchr(name, ',');
+    size_t len = (end ? end - name : strlen(name));
+    const char* colon = static_cast<const char*>(memchr(name, ':', len));
+    size_t name_len = (colon ? colon - name : len);
+    bool short_name = !memchr(name, '.', name_len);
+
+    // A short name matches the first label of the host
+    if ((name_len > 0) && !host.compare(0, name_len, name, name_len) &&
+        ((host.length() == name_len) ||
+         (short_name && (host[name_len] == '.'))))
+      return true;
+
+    if (!end)
+      break;
+
+    name = end + 1;
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Drop the cached entry which sent to EOS a client which failed there
+//------------------------------------------------------------------------------
+void
+EosRucioCms::DropTried(const char* lfn, const char* tident, const char* triedrc)
+{
+  RucioName rname;
+  char pfn_partial[sPfnMaxLen];
+  mNumTried++;
+
+  if (Translate(lfn, strlen(lfn), rname, pfn_partial, sizeof(pfn_partial)) >= 0)
+  {
+    if (mCache && mCache->ErasePositive(rname.digest))
+      mNumTriedErased++;
+
+    // The client is not sent back to the storage nodes it failed on
+    for (size_t i = 0; mReplicas && (i < mTokens.Size()); ++i)
+      mReplicas->Erase(mTokens.GetName(i) + pfn_partial);
+  }
+
+  std::string msg = "EOS already tried";
+
+  if (triedrc)
+  {
+    msg += " with rc=";
+    msg += triedrc;
+  }
+
+  msg += ", redirect to uplink_mgr for lfn=";
+  RucioError.Emsg("Locate", tident, msg.c_str(), lfn);
+}
+
+
+//------------------------------------------------------------------------------
+// Get the space token named by the hint of a client
+//------------------------------------------------------------------------------
+int
+EosRucioCms::GetHintToken(const char* hint) const
+{
+  std::map<std::string, int>::const_iterator it = mHintTokens.find(hint);
+
+  if (it == mHintTokens.end())
+  {
+    std::string name = hint;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    it = mHintTokens.find(name);
+
+    if (it == mHintTokens.end())
+      return -1;
+  }
+
+  return it->second;
+}
+
+
+//------------------------------------------------------------------------------
+// Start the existence check of an lfn
+//------------------------------------------------------------------------------
+EosRucioCms::CheckState
+EosRucioCms::BeginCheck(PfnCheck& check, const char* lfn, bool refresh,
+                        SingleFlight::Result& result)
+{
+  check.lfn = lfn;
+  RucioName& rname = check.rname;
+  int retc = Translate(check.lfn.c_str(), check.lfn.length(), rname,
+                       check.pfn_partial, sizeof(check.pfn_partial));
+
+  // If Rucio translation fails, we return an empty string
+  if (retc < 0)
+  {
+    LogTranslateError(retc);
+    return eCheckDone;
+  }
+
+  // While all the EOS endpoints are unavailable the locate goes to the
+  // uplink without delay
+  int endpoint = mEosEndpoints.Pick();
+
+  if (endpoint < 0)
+    return eCheckDone;
+
+  // A routing rule limits or reorders the space tokens to probe, the scope
+  // is matched once per locate
+  const RouteTrie::Rule* route = (mRoutes.GetNumRules() ?
+                                  mRoutes.Match(rname.scope, rname.scope_len) : 0);
+
+  // A file whose first space token to probe holds all its files is there,
+  // the client is redirected without waiting for a stat. The token named by
+  // the client is probed first so it decides, a hint naming a token which
+  // is not authoritative goes through the existence check.
+  if (!check.verify && !mAuthoritative.empty())
+  {
+    int first = (check.hint >= 0 ? check.hint : GetFirstToken(route));
+
+    if ((first >= 0) && mAuthoritative[first])
+    {
+      result.pfn = mTokens.GetName(first) + check.pfn_partial;
+      result.endpoint = endpoint;
+      mNumAuthoritative++;
+      return eCheckDone;
+    }
+  }
+
+  // A recent outcome of the existence check is reused unless a refresh is
+  // requested by the client. Any endpoint serves a cached file. The cache
+  // does not keep the metadata needed by the stat of the Ofs plugin so the
+  // files found in EOS are stated again for it.
+  int token = PfnCache::sNotFound;
+
+  if (mCache && !refresh && mCache->Get(rname.digest, token) &&
+      !(check.verify && (token != PfnCache::sNotFound)))
+  {
+    if (token != PfnCache::sNotFound)
+    {
+      result.pfn = mTokens.GetName(token) + check.pfn_partial;
+      result.endpoint = endpoint;
+      mTokens.AddHit(token);
+    }
+
+    return eCheckDone;
+  }
+
+  // Concurrent locates of the same file share one existence check. A client
+  // over the limit of its QoS class may join a check but never leads one, so
+  // that its limit is not imposed on the clients joining the check.
+  // A check probing only the token named by the client can not tell the
+  // others that the file is not in EOS, it is only shared with the locates
+  // naming the same token.
+  if ((check.hint >= 0) && (mHintMode == eHintOnly))
+    check.tag = check.hint;
+
+  check.flight = mInFlight.Follow(rname.digest, check.tag);
+
+  if (check.flight)
+  {
+    mNumCoalesced++;
+    return eCheckFollow;
+  }
+
+  if (!AdmitQos(check))
+  {
+    result = ShedCheck(check, "QoS limit reached,");
+    return eCheckDone;
+  }
+
+  bool leader = false;
+  check.flight = mInFlight.Join(rname.digest, leader, check.tag);
+
+  if (!leader)
+  {
+    // A concurrent locate started the check in the meantime
+    if (check.qos_admitted)
+    {
+      mQos.Release(check.qos);
+      check.qos_admitted = false;
+    }
+
+    mNumCoalesced++;
+    return eCheckFollow;
+  }
+
+  // The reference keeps the snapshot alive while the candidates are added,
+  // a fold waits for it before freeing the snapshot
+  TokenTable::SnapshotRef snapshot(mTokens);
+  std::vector<int>& order = check.order;
+
+  if (route)
+  {
+    order = route->tokens;
+
+    if (route->others)
+    {
+      for (auto it = snapshot->order.begin(); it != snapshot->order.end(); ++it)
+      {
+        if (std::find(route->tokens.begin(), route->tokens.end(), *it) ==
+            route->tokens.end())
+          order.push_back(*it);
+      }
+    }
+  }
+  else
+  {
+    order = snapshot->order;
+  }
+
+  // The files of a scope usually live in the same space token, probe it first
+  check.predicted = (mScopes ? mScopes->Predict(rname.scope, rname.scope_len) : -1);
+
+  if (check.predicted >= 0)
+  {
+    auto it = std::find(order.begin(), order.end(), check.predicted);
+
+    if (it != order.end())
+      std::rotate(order.begin(), it, it + 1);
+  }
+
+  // The token named by the client comes before the prediction, even if the
+  // routing rule leaves it out
+  if (check.hint >= 0)
+  {
+    auto it = std::find(order.begin(), order.end(), check.hint);
+
+    if (mHintMode == eHintOnly)
+      order.assign(1, check.hint);
+    else if (it != order.end())
+      std::rotate(order.begin(), it, it + 1);
+    else
+      order.insert(order.begin(), check.hint);
+  }
+
+  // The space tokens at their limit of outstanding stats are probed last, by
+  // then they may have room again otherwise they are skipped
+  std::vector<int> full;
+  size_t num_free = 0;
+
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    Bulkhead* bulkhead = mTokens.GetBulkhead(order[i]);
+
+    if (bulkhead->IsFull())
+    {
+      bulkhead->AddDemoted();
+      full.push_back(order[i]);
+    }
+    else
+    {
+      order[num_free++] = order[i];
+    }
+  }
+
+  std::copy(full.begin(), full.end(), order.begin() + num_free);
+
+  // The check goes to the least loaded healthy EOS endpoint, the breaker of
+  // a half-open one lets only its trial check through
+  check.endpoint = mEosEndpoints.Acquire(check.breaker_trial);
+
+  if (check.endpoint < 0)
+  {
+    result = ShedCheck(check, "EOS unavailable,");
+    return eCheckDone;
+  }
+
+  std::stringstream sstr;
+  // Put a timeout of 5 seconds just to be on the safe side since by default
+  // if the file can not be found, the server requests a timeout of 120 seconds
+  check.probe = new PfnProbe(mEosEndpoints.Get(check.endpoint).fs, mProbeMode,
+                             5, mHedgePct);
+
+  for (auto it = order.begin(); it != order.end(); ++it)
+  {
+    const std::string& space_tkn = mTokens.GetName(*it);
+    sstr << "Check in path: " << space_tkn << " with priority: "
+         << snapshot->priority[*it] << " score: " << snapshot->score[*it];
+    RucioError.Emsg("GetValidPfn", sstr.str().c_str());
+    sstr.str("");
+    check.probe->AddCandidate(space_tkn + check.pfn_partial,
+                              mTokens.GetLatency(*it),
+                              mTokens.GetBulkhead(*it));
+  }
+
+  // With a deadline the timeout of each stat adapts to the latency of its
+  // space token and the request goes to the uplink once the budget is spent
+  if (mLocateDeadline)
+    check.probe->SetDeadline(static_cast<uint64_t>(mLocateDeadline) * 1000);
+
+  return eCheckProbe;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the space token always probed first for a Rucio name
+//------------------------------------------------------------------------------
+int
+EosRucioCms::GetFirstToken(const RouteTrie::Rule* route)
+{
+  if (route)
+    return (route->tokens.empty() ? -1 : route->tokens.front());
+
+  // Without a rule the order follows the scores which change over time, it
+  // is only known for sure with a single space token
+  return (mTokens.Size() == 1 ? 0 : -1);
+}
+
+
+//------------------------------------------------------------------------------
+// Wait synchronously for the outcome of a check
+//------------------------------------------------------------------------------
+SingleFlight::Result
+EosRucioCms::WaitCheck(PfnCheck& check, CheckState state)
+{
+  if (state == eCheckFollow)
+    return mInFlight.Wait(check.flight);
+
+  if (!mDispatcher.Acquire())
+    return ShedCheck(check, "EOS overloaded,");
+
+  check.start_us = LatencyStats::NowUs();
+  check.probe->Start();
+  check.probe->Wait();
+  return EndCheck(check);
+}
+
+
+//------------------------------------------------------------------------------
+// Account for the outcome of a completed probe
+//------------------------------------------------------------------------------
+SingleFlight::Result
+EosRucioCms::EndCheck(PfnCheck& check)
+{
+  SingleFlight::Result result;
+  PfnProbe* probe = check.probe;
+  RucioName& rname = check.rname;
+  uint64_t service_us = LatencyStats::NowUs() - check.start_us;
+  mProbeLatency.AddLatency(service_us);
+  mDispatcher.Release(service_us);
+
+  if (check.qos_admitted)
+    mQos.Release(check.qos);
+
+  int winner = probe->GetWinner();
+  int token = PfnCache::sNotFound;
+  size_t num_hedged = 0;
+  size_t num_sent = probe->GetNumSent(num_hedged);
+  mNumStats += num_sent;
+  mNumHedged += num_hedged;
+  mNumProbes++;
+
+  // Any reply, even an error like file not found, shows that EOS is alive
+  CircuitBreaker::Outcome outcome = CircuitBreaker::eUnknown;
+
+  if (probe->GetNumAnswered())
+    outcome = CircuitBreaker::eSuccess;
+  else if (num_sent)
+    outcome = CircuitBreaker::eFailure;
+
+  if (mEosEndpoints.Release(check.endpoint, outcome, check.breaker_trial))
+    LogBreaker(check.endpoint, check.breaker_trial ? "trial check" :
+               "failed checks");
+
+  if (probe->IsExpired())
+  {
+    mNumExpired++;
+    RucioError.Emsg("GetValidPfn", "Deadline expired for lfn:",
+                    check.lfn.c_str());
+  }
+
+  if (check.hint >= 0)
+    mNumHintProbes++;
+
+  if (winner >= 0)
+  {
+    token = check.order[winner];
+
+    if (token == check.hint)
+      mNumHintHits++;
+
+    result.pfn = probe->GetPfn(winner);
+    result.endpoint = check.endpoint;
+    // The stat of the Ofs plugin answers with the metadata of the file and
+    // an inode number which is the same for every stat of the file
+    result.has_stat = probe->GetWinnerStat(result.size, result.mtime,
+                                           result.flags);
+    memcpy(&result.ino, rname.digest, sizeof(result.ino));
+    RucioError.Emsg("GetValidPfn", "Stat successful for pfn:", result.pfn.c_str());
+    // Update the priority, the probing order follows at the next fold
+    mTokens.AddHit(token);
+
+    if (mScopes)
+    {
+      mScopes->Update(rname.scope, rname.scope_len, token);
+
+      if (check.predicted >= 0)
+      {
+        mNumPredicted++;
+
+        if (token != check.predicted)
+          mNumMispredicted++;
+      }
+    }
+  }
+
+  // Failed or timed out stats say nothing about the existence of the file,
+  // nor does a miss in the only token named by the client
+  if (mCache && probe->IsConclusive() && ((winner >= 0) || (check.tag < 0)))
+    mCache->Put(rname.digest, token);
+
+  // The replies which are still outstanding are dropped
+  probe->Release();
+  check.probe = 0;
+  check.endpoint = -1;
+  mInFlight.Complete(rname.digest, check.flight, result, check.tag);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Admit an existence check in the QoS class of its client
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::AdmitQos(PfnCheck& check)
+{
+  if (check.qos < 0)
+    return true;
+
+  check.qos_admitted = (mQos.Admit(check.qos, check.client) ==
+                        QosTable::eAllowed);
+  return check.qos_admitted;
+}
+
+
+//------------------------------------------------------------------------------
+// Give up an existence check which was not admitted
+//------------------------------------------------------------------------------
+SingleFlight::Result
+EosRucioCms::ShedCheck(PfnCheck& check, const char* reason)
+{
+  RucioError.Emsg("GetValidPfn", reason, "check skipped for lfn:",
+                  check.lfn.c_str());
+
+  if (check.qos_admitted)
+  {
+    mQos.Release(check.qos);
+    check.qos_admitted = false;
+  }
+
+  if (check.endpoint >= 0)
+  {
+    mEosEndpoints.Release(check.endpoint, CircuitBreaker::eUnknown,
+                          check.breaker_trial);
+    check.endpoint = -1;
+  }
+
+  if (check.probe)
+  {
+    check.probe->Release();
+    check.probe = 0;
+  }
+
+  // The outcome is unknown so nothing is cached and the concurrent locates
+  // of the same file go to the uplink as well. A check shed before leading
+  // a flight has no followers.
+  SingleFlight::Result result;
+
+  if (check.flight)
+  {
+    mInFlight.Complete(check.rname.digest, check.flight, result, check.tag);
+    check.flight = 0;
+  }
+
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse unsigned integer configuration value
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::ParseUnsigned(const char* tag, const char* val,
+                           unsigned int& value)
+{
+  char* endptr;
+  errno = 0;
+  unsigned long num = strtoul(val, &endptr, 10);
+
+  if (errno || (endptr == val) || *endptr || (num > UINT_MAX))
+  {
+    RucioError.Emsg("Configure", "Invalid numeric value for", tag, val);
+    return false;
+  }
+
+  value = static_cast<unsigned int>(num);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse non-negative floating point configuration value
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::ParseDouble(const char* tag, const char* val, double& value)
+{
+  char* endptr;
+  errno = 0;
+  double num = strtod(val, &endptr);
+
+  if (errno || (endptr == val) || *endptr || !(num >= 0.0))
+  {
+    RucioError.Emsg("Configure", "Invalid numeric value for", tag, val);
+    return false;
+  }
+
+  value = num;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse parameter of a QoS class
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::ParseQosParam(const char* param, QosTable::Limits& limits,
+                           std::vector<QosTable::Match>& matches)
+{
+  const char* eq = strchr(param, '=');
+
+  if (!eq || (eq == param) || !*(eq + 1))
+  {
+    RucioError.Emsg("Configure", "Invalid QoS parameter", param);
+    return false;
+  }
+
+  std::string key(param, eq - param);
+  const char* val = eq + 1;
+
+  if (key == "rate")
+    return ParseDouble(param, val, limits.rate);
+  else if (key == "burst")
+    return ParseDouble(param, val, limits.burst);
+  else if (key == "clientrate")
+    return ParseDouble(param, val, limits.client_rate);
+  else if (key == "clientburst")
+    return ParseDouble(param, val, limits.client_burst);
+  else if (key == "share")
+  {
+    if (!ParseUnsigned(param, val, limits.share))
+      return false;
+
+    if ((limits.share < 1) || (limits.share > 100))
+    {
+      RucioError.Emsg("Configure", "QoS share must be in [1, 100]");
+      return false;
+    }
+
+    return true;
+  }
+
+  QosTable::Match match;
+
+  if (key == "name")
+    match.field = QosTable::eName;
+  else if (key == "host")
+    match.field = QosTable::eHost;
+  else if (key == "vorg")
+    match.field = QosTable::eVorg;
+  else if (key == "role")
+    match.field = QosTable::eRole;
+  else if (key == "tident")
+    match.field = QosTable::eTident;
+  else
+  {
+    RucioError.Emsg("Configure", "Unknown QoS parameter", param);
+    return false;
+  }
+
+  // The pattern matches any value starting with it
+  match.pattern = val;
+  match.prefix = (match.pattern.at(match.pattern.length() - 1) == '*');
+
+  if (match.prefix)
+    match.pattern.erase(match.pattern.length() - 1);
+
+  matches.push_back(match);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse endpoint given as host:port
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::ParseHostPort(const char* tag, const char* val, std::string& host,
+                           unsigned int& port)
+{
+  const char* colon = strrchr(val, ':');
+
+  if (!colon || (colon == val) || !ParseUnsigned(tag, colon + 1, port) || !port)
+  {
+    RucioError.Emsg("Configure", "Endpoint must be given as host:port", val);
+    return false;
   }
 
-  // Check that the EOS instance is valid
-  if (mEosHost.empty() || (mEosPort == 0))
+  host.assign(val, colon - val);
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Parse parameter of an EOS endpoint or of an uplink
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::ParseEndpointParam(const char* param, unsigned int& weight,
+                                EndpointSet::Role& role)
+{
+  const char* eq = strchr(param, '=');
+
+  if (!eq || (eq == param) || !*(eq + 1))
   {
-    RucioError.Emsg("Configure", "EOS redirect instance value missing/invalid",
-                    "Example \"eosrucio.eoshost eosatlas.cern.ch\"",
-                    "        \"eosrucio.eosport 1094\"");
-    success = 0;
-    return success;
+    RucioError.Emsg("Configure", "Invalid endpoint parameter", param);
+    return false;
   }
-  else
+
+  std::string key(param, eq - param);
+  const char* val = eq + 1;
+
+  if (key == "weight")
   {
-    std::stringstream sstr;
-    sstr << mEosHost << ":" << mEosPort;
-    mEosInstance = sstr.str();
-    XrdCl::URL url(mEosInstance);
+    if (!ParseUnsigned(param, val, weight))
+      return false;
 
-    if (!url.IsValid())
+    if (!weight)
     {
-      RucioError.Emsg("Configure ", "EOS redirect url is not valid");
-      mEosInstance = "";
-      success = 0;
+      RucioError.Emsg("Configure", "Endpoint weight must be > 0");
+      return false;
     }
-  }
 
-  // Check that the uplink redirect is valid
-  if (mUplinkHost.empty() || (mUplinkPort == 0))
-  {
-    RucioError.Emsg("Configure", "Uplink instance value missing/invalid",
-                    "Example \"eosrucio.uphost atlas-xrd-eu.cern.ch\"",
-                    "        \"eosrucio.upport 1094\"");
-    success = 0;
-    return success;
+    return true;
   }
-  else
+  else if (key == "role")
   {
-    std::stringstream sstr;
-    sstr << mUplinkHost << ":" << mUplinkPort;
-    mUplinkInstance = sstr.str();
-    XrdCl::URL url(mUplinkInstance);
-
-    if (!url.IsValid())
+    if (!strcmp(val, "primary"))
+      role = EndpointSet::ePrimary;
+    else if (!strcmp(val, "backup"))
+      role = EndpointSet::eBackup;
+    else
     {
-      RucioError.Emsg("Configure ", "Uplink redirect url is not valid");
-      mUplinkInstance = "";
-      success = 0;
+      RucioError.Emsg("Configure", "Unknown endpoint role", val);
+      return false;
     }
-  }
 
-  // Check that the Rucio site name was specified
-  if (mSiteName.empty())
-  {
-    RucioError.Emsg("Configure", "Mandatory site name value missing.",
-                    "Example \"eosrucio.site CERN-EOS\"");
-    success = 0;
-    return success;
+    return true;
   }
 
-  RucioError.Say("EosRucioCms::Configure ", "Json file: ", mJsonFile.c_str());
-  RucioError.Say("EosRucioCms::Configure ", "AGIS site: ", mAgisSite.c_str());
-  RucioError.Say("EosRucioCms::Configure ", "Site: ", mSiteName.c_str());
+  RucioError.Emsg("Configure", "Unknown endpoint parameter", param);
+  return false;
+}
 
-  if (mMapSpace.empty())
+
+//------------------------------------------------------------------------------
+// Start maintenance thread
+//------------------------------------------------------------------------------
+void*
+EosRucioCms::StartMaintenance(void* arg)
+{
+  EosRucioCms* cms = static_cast<EosRucioCms*>(arg);
+  cms->Maintenance();
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Maintenance loop running the periodic tasks of the plugin
+//------------------------------------------------------------------------------
+void
+EosRucioCms::Maintenance()
+{
+  uint64_t last_report = LatencyStats::NowUs();
+  uint64_t last_ping = last_report;
+  uint64_t last_canary = last_report;
+  uint64_t last_uplink_ping = last_report;
+  mMaintenanceCond.Lock();
+
+  while (!mStopMaintenance)
   {
-    bool done_agis = false;
-    bool done_json = false;
+    mMaintenanceCond.WaitMS(1000);
 
-    // This means that the overwriteSE tag did not specify any tokens, therefore
-    // we need first to check the AGIS site and then the local JSON file
-    if (!mAgisSite.empty())
+    if (mStopMaintenance)
+      break;
+
+    mMaintenanceCond.UnLock();
+    uint64_t now = LatencyStats::NowUs();
+    // Publish the probing order updated with the latest hits
+    mTokens.Fold();
+
+    if (mReportInterval &&
+        (now - last_report >= static_cast<uint64_t>(mReportInterval) * 1000000))
     {
-      // Try to read configuration of space tokens from the AGIS site
-      RucioError.Say("Configure: ", "Trying to read config from AGIS site");
-      done_agis = ReadAgisConfig();
+      ReportStats();
+      last_report = now;
     }
 
-    if (!done_agis && !mJsonFile.empty())
+    if (mKeepAlive &&
+        (now - last_ping >= static_cast<uint64_t>(mKeepAlive) * 1000000))
     {
-      // Try to read configuration of space tokens from the json file
-      RucioError.Say("Configure: ", "Trying to read config from JSON file");
-      done_json = ReadLocalJson(mJsonFile);
+      for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
+        SendKeepalive(i);
+
+      last_ping = now;
     }
 
-    if (!done_agis && !done_json)
+    if (!mCanaryPath.empty() &&
+        (now - last_canary >= static_cast<uint64_t>(mCanaryInterval) * 1000000))
     {
-      RucioError.Emsg("Configure",
-                      "No resource (overwriteSE, AGIS site or local (JSON file)) from",
-                      "which to read the space tokend is available");
-      success = 0;
-    }
-  }
+      for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
+        SendCanary(i);
 
-  // Check that we have some mappings defined
-  if (mMapSpace.empty())
-  {
-    RucioError.Emsg("Configure", "The Rucio space token map is empty");
-    success = 0;
-  }
+      last_canary = now;
+    }
 
-  RucioError.Emsg("Configure", "Contents of the space tokens map is:");
-  std::stringstream ss;
+    // With a single uplink there is nothing to choose from
+    if ((mUplinks.GetSize() > 1) &&
+        (now - last_uplink_ping >= static_cast<uint64_t>(mUplinkPing) * 1000000))
+    {
+      PingUplinks();
+      last_uplink_ping = now;
+    }
 
-  for (auto entry = mMapSpace.begin(); entry != mMapSpace.end(); entry++)
-  {
-    ss << entry->second;
-    RucioError.Say(entry->first.c_str(), " " , ss.str().c_str());
-    ss.str("");
+    mMaintenanceCond.Lock();
   }
 
-  return success;
+  mMaintenanceCond.UnLock();
 }
 
 
 //------------------------------------------------------------------------------
-// Locate
+// Log the statistics about the existence checks done in EOS
 //------------------------------------------------------------------------------
-int
-EosRucioCms::Locate(XrdOucErrInfo& Resp,
-                    const char* path,
-                    int flags,
-                    XrdOucEnv* Info)
+void
+EosRucioCms::ReportStats()
 {
-  // Get identity of the caller
-  XrdSecEntity* sec_entity = NULL;
-
-  if (Info)
+  char buff[512];
+  uint64_t num_probes = mNumProbes;
+  uint64_t num_stats = mNumStats;
+  uint64_t num_hedged = mNumHedged;
+  uint64_t num_expired = mNumExpired;
+  uint64_t num_ping_errors = mNumPingErrors;
+  uint64_t num_coalesced = mNumCoalesced;
+  uint64_t num_async = mNumAsync;
+  int64_t num_pending = mNumPending;
+  uint64_t num_metalink = mNumMetalink;
+  uint64_t num_authoritative = mNumAuthoritative;
+  PfnCache::Stats cstats;
+  snprintf(buff, sizeof(buff), "probes=%llu stats=%llu hedged=%llu expired=%llu "
+           "ping_errors=%llu coalesced=%llu async=%llu pending=%lld "
+           "metalink=%llu authoritative=%llu extra_stat_rate=%.2f%% "
+           "probe_p50=%.3fms probe_p99=%.3fms",
+           (unsigned long long) num_probes, (unsigned long long) num_stats,
+           (unsigned long long) num_hedged, (unsigned long long) num_expired,
+           (unsigned long long) num_ping_errors,
+           (unsigned long long) num_coalesced,
+           (unsigned long long) num_async, (long long) num_pending,
+           (unsigned long long) num_metalink,
+           (unsigned long long) num_authoritative,
+           (num_stats ? 100.0 * num_hedged / num_stats : 0.0),
+           mProbeLatency.GetPercentile(50) / 1000.0,
+           mProbeLatency.GetPercentile(99) / 1000.0);
+  RucioError.Say("EosRucioCms::ReportStats ", buff);
+
+  // Load and health of each EOS endpoint
+  for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
   {
-    sec_entity = const_cast<XrdSecEntity*>(Info->secEnv());
+    EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(i);
+    uint64_t num_trips, num_rejected, num_trials;
+    endpoint.breaker.GetCounters(num_trips, num_rejected, num_trials);
+    uint64_t num_checks = endpoint.num_checks;
+    uint64_t num_canaries = endpoint.num_canaries;
+    uint64_t num_canary_errors = endpoint.num_canary_errors;
+    snprintf(buff, sizeof(buff), " role=%s weight=%u in_flight=%u checks=%llu "
+             "breaker=%s trips=%llu rejected=%llu trials=%llu canaries=%llu "
+             "canary_errors=%llu", EndpointSet::GetRoleName(endpoint.role),
+             endpoint.weight, endpoint.in_flight.load(),
+             (unsigned long long) num_checks,
+             EndpointSet::GetStateName(endpoint.breaker.GetState()),
+             (unsigned long long) num_trips, (unsigned long long) num_rejected,
+             (unsigned long long) num_trials, (unsigned long long) num_canaries,
+             (unsigned long long) num_canary_errors);
+    RucioError.Say("EosRucioCms::ReportStats eos=", endpoint.instance.c_str(),
+                   buff);
+  }
 
-    if (!sec_entity)
+  snprintf(buff, sizeof(buff), "eos unavailable=%llu",
+           (unsigned long long) mEosEndpoints.GetNumUnavailable());
+  RucioError.Say("EosRucioCms::ReportStats ", buff);
+
+  // Round trip time and health of each uplink
+  if (mUplinks.GetSize() > 1)
+  {
+    for (size_t i = 0; i < mUplinks.GetSize(); ++i)
     {
-      sec_entity = new XrdSecEntity("");
-      sec_entity->tident = new char[16];
-      sec_entity->tident = strncpy(sec_entity->tident, "unknown", 7);
+      EndpointSet::Endpoint& uplink = mUplinks.Get(i);
+      uint64_t num_trips, num_rejected, num_trials;
+      uplink.breaker.GetCounters(num_trips, num_rejected, num_trials);
+      uint64_t num_redirects = uplink.num_checks;
+      uint64_t num_pings = uplink.num_canaries;
+      uint64_t num_ping_errors = uplink.num_canary_errors;
+      snprintf(buff, sizeof(buff), " role=%s weight=%u rtt=%.3fms redirects=%llu "
+               "breaker=%s trips=%llu pings=%llu ping_errors=%llu",
+               EndpointSet::GetRoleName(uplink.role), uplink.weight,
+               uplink.rtt_us.load() / 1000.0, (unsigned long long) num_redirects,
+               EndpointSet::GetStateName(uplink.breaker.GetState()),
+               (unsigned long long) num_trips, (unsigned long long) num_pings,
+               (unsigned long long) num_ping_errors);
+      RucioError.Say("EosRucioCms::ReportStats uplink=", uplink.instance.c_str(),
+                     buff);
     }
+
+    snprintf(buff, sizeof(buff), "uplink unavailable=%llu",
+             (unsigned long long) mUplinks.GetNumUnavailable());
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
   }
 
-  // Compute the Rucio pfn using the algorithm and redirect to the correct
-  // location - this also stats the file in EOS
-  std::string pfn = GetValidPfn(path);
-  std::string ret_string;
+  if (mMaxChecks)
+  {
+    StatDispatcher::Stats dstats;
+    mDispatcher.GetStats(dstats);
+    LatencyStats& queue_latency = mDispatcher.GetQueueLatency();
+    snprintf(buff, sizeof(buff), "dispatcher in_flight=%llu queued=%llu "
+             "admitted=%llu shed_full=%llu shed_wait=%llu queue_p50=%.3fms "
+             "queue_p99=%.3fms",
+             (unsigned long long) dstats.in_flight,
+             (unsigned long long) dstats.queued,
+             (unsigned long long) dstats.admitted,
+             (unsigned long long) dstats.shed_full,
+             (unsigned long long) dstats.shed_wait,
+             queue_latency.GetPercentile(50) / 1000.0,
+             queue_latency.GetPercentile(99) / 1000.0);
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
+  }
 
-  if (!pfn.empty())
+  for (size_t i = 0; i < mQos.GetNumClasses(); ++i)
   {
-    ret_string = mEosHost;
-    ret_string += "?eos.lfn=";
-    ret_string += pfn;
-    ret_string += "&eos.app=lfc";
-    Resp.setErrCode(mEosPort);
+    const QosTable::Class& cls = mQos.GetClass(i);
+    uint64_t num_requests = cls.num_requests;
+    uint64_t num_rate_limited = cls.num_rate_limited;
+    uint64_t num_client_limited = cls.num_client_limited;
+    uint64_t num_share_limited = cls.num_share_limited;
+    snprintf(buff, sizeof(buff), " checks=%llu admitted=%llu rate_limited=%llu "
+             "client_limited=%llu share_limited=%llu in_flight=%u",
+             (unsigned long long) num_requests,
+             (unsigned long long)(num_requests - num_rate_limited -
+                                  num_client_limited - num_share_limited),
+             (unsigned long long) num_rate_limited,
+             (unsigned long long) num_client_limited,
+             (unsigned long long) num_share_limited, cls.in_flight.load());
+    RucioError.Say("EosRucioCms::ReportStats qos=", cls.name.c_str(), buff);
   }
-  else
+
+  if (mCache)
   {
-    if ((strcmp(path, "/atlas") == 0))
-    {
-      RucioError.Emsg("Locate", sec_entity->tident,
-                      "for \"/atlas\" we return OK");
-      Resp.setErrData(0);
-      return SFS_DATA;
-    }
-    else
-    {
-      RucioError.Emsg("Locate", sec_entity->tident,
-                      "error=pfn not found, redirect to uplink_mgr for lfn=", path);
-      ret_string = mUplinkHost;
-      Resp.setErrCode(mUplinkPort);
-    }
+    mCache->GetStats(cstats);
+    uint64_t num_lookups = cstats.hits + cstats.neg_hits + cstats.misses;
+    snprintf(buff, sizeof(buff), "cache hits=%llu neg_hits=%llu misses=%llu "
+             "hit_rate=%.2f%% inserts=%llu evictions=%llu entries=%llu/%llu",
+             (unsigned long long) cstats.hits, (unsigned long long) cstats.neg_hits,
+             (unsigned long long) cstats.misses,
+             (num_lookups ? 100.0 * (cstats.hits + cstats.neg_hits) / num_lookups : 0.0),
+             (unsigned long long) cstats.inserts,
+             (unsigned long long) cstats.evictions,
+             (unsigned long long) cstats.entries,
+             (unsigned long long) cstats.capacity);
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
   }
 
-  Resp.setErrData(ret_string.c_str());
-  return SFS_REDIRECT;
+  if (mReplicas)
+  {
+    ReplicaCache::Stats rstats;
+    mReplicas->GetStats(rstats);
+    uint64_t num_replica_errors = mNumReplicaErrors;
+    snprintf(buff, sizeof(buff), "replicas direct=%llu misses=%llu fetches=%llu "
+             "errors=%llu entries=%llu/%u",
+             (unsigned long long) rstats.hits, (unsigned long long) rstats.misses,
+             (unsigned long long) rstats.fetches,
+             (unsigned long long) num_replica_errors,
+             (unsigned long long) rstats.entries, mReplicaEntries);
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
+  }
+
+  uint64_t num_tried = mNumTried;
+
+  if (num_tried)
+  {
+    uint64_t num_tried_erased = mNumTriedErased;
+    snprintf(buff, sizeof(buff), "tried eos=%llu cache_dropped=%llu",
+             (unsigned long long) num_tried,
+             (unsigned long long) num_tried_erased);
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
+  }
+
+  if (mHintMode != eHintOff)
+  {
+    uint64_t num_hints = mNumHints;
+    uint64_t num_hint_unknown = mNumHintUnknown;
+    uint64_t num_hint_probes = mNumHintProbes;
+    uint64_t num_hint_hits = mNumHintHits;
+    snprintf(buff, sizeof(buff), "hints known=%llu unknown=%llu probes=%llu "
+             "hits=%llu accuracy=%.2f%%",
+             (unsigned long long) num_hints,
+             (unsigned long long) num_hint_unknown,
+             (unsigned long long) num_hint_probes,
+             (unsigned long long) num_hint_hits,
+             (num_hint_probes ? 100.0 * num_hint_hits / num_hint_probes : 0.0));
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
+  }
+
+  if (mScopes)
+  {
+    uint64_t num_predicted = mNumPredicted;
+    uint64_t num_mispredicted = mNumMispredicted;
+    snprintf(buff, sizeof(buff), "scopes predicted=%llu mispredicted=%llu "
+             "accuracy=%.2f%% entries=%llu/%llu",
+             (unsigned long long) num_predicted,
+             (unsigned long long) num_mispredicted,
+             (num_predicted ? 100.0 * (num_predicted - num_mispredicted) /
+              num_predicted : 0.0),
+             (unsigned long long) mScopes->GetNumUsed(),
+             (unsigned long long) mScopes->GetCapacity());
+    RucioError.Say("EosRucioCms::ReportStats ", buff);
+  }
+
+  for (size_t i = 0; i < mRoutes.GetNumRules(); ++i)
+  {
+    const RouteTrie::Rule& rule = mRoutes.GetRule(i);
+    snprintf(buff, sizeof(buff), " hits=%llu",
+             (unsigned long long) rule.hits.load(std::memory_order_relaxed));
+    RucioError.Say("EosRucioCms::ReportStats route=", rule.prefix.c_str(), "*",
+                   buff);
+  }
+
+  TokenTable::SnapshotRef snapshot(mTokens);
+
+  for (auto it = snapshot->order.begin(); it != snapshot->order.end(); ++it)
+  {
+    uint64_t num_ok, num_err, num_rejected, num_demoted;
+    unsigned int in_flight;
+    LatencyStats* stats = mTokens.GetLatency(*it);
+    Bulkhead* bulkhead = mTokens.GetBulkhead(*it);
+    stats->GetCounters(num_ok, num_err);
+    bulkhead->GetCounters(in_flight, num_rejected, num_demoted);
+    snprintf(buff, sizeof(buff), " score=%.4g rate=%.2f priority=%llu "
+             "replies=%llu errors=%llu p50=%.3fms hedge_p%u=%.3fms "
+             "in_flight=%u/%u rejected=%llu demoted=%llu",
+             snapshot->score[*it], snapshot->rate[*it],
+             (unsigned long long) snapshot->priority[*it],
+             (unsigned long long) num_ok, (unsigned long long) num_err,
+             stats->GetPercentile(50) / 1000.0, mHedgePct,
+             stats->GetPercentile(mHedgePct) / 1000.0, in_flight,
+             bulkhead->GetLimit(), (unsigned long long) num_rejected,
+             (unsigned long long) num_demoted);
+    RucioError.Say("EosRucioCms::ReportStats token=",
+                   mTokens.GetName(*it).c_str(), buff);
+  }
 }
 
 
 //------------------------------------------------------------------------------
-// Translate logical file name to physical file name using the Rucio alg.
+// Handle the reply of a canary stat
 //------------------------------------------------------------------------------
-std::string
-EosRucioCms::Translate(std::string lfn)
+void
+EosRucioCms::CanaryHandler::HandleResponse(XrdCl::XRootDStatus* status,
+                                           XrdCl::AnyObject* response)
 {
-  std::string pfn = "";
-  std::string file_name = "";
-  std::string scope = "";
-  std::string prefix = "/atlas/rucio/";
+  // An error reply from the server still shows that EOS is alive
+  bool ok = (status && (status->IsOK() ||
+                        (status->code == XrdCl::errErrorResponse)));
+  delete status;
+  delete response;
+  mCms->CanaryDone(mEndpoint, ok);
+  delete this;
+}
 
-  // We only translate file names that begin with /atlas
-  if (lfn.compare(0, prefix.length(), prefix) == 0)
-  {
-    std::string tmp = lfn.substr(prefix.length(), lfn.length() - prefix.length());
-    size_t last_colon = tmp.find_last_of(':');
 
-    if (last_colon != std::string::npos)
-    {
-      file_name = tmp.substr(last_colon + 1);
-      scope = tmp.substr(0, last_colon);
-    }
-    else
-    {
-      size_t last_slash = tmp.find_last_of('/');
-      file_name = tmp.substr(last_slash + 1);
-      scope = tmp.substr(0, last_slash);
-    }
+//------------------------------------------------------------------------------
+// Send a canary stat to an EOS endpoint
+//------------------------------------------------------------------------------
+void
+EosRucioCms::SendCanary(int index)
+{
+  EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(index);
 
-    if (file_name.empty() || scope.empty())
-    {
-      RucioError.Emsg("Translate", "Error extracting scope and/or file name");
-      return pfn;
-    }
+  // A canary stat which hangs is not doubled up
+  if (endpoint.canary_in_flight.exchange(true))
+    return;
 
-    //RucioError.Say("File name: ", file_name.c_str(), " scope: ", scope.c_str());
-    std::string scope_file = scope + ":" + file_name;
+  endpoint.num_canaries++;
+  uint16_t timeout = static_cast<uint16_t>(mCanaryInterval < 5 ?
+                     mCanaryInterval : 5);
+  CanaryHandler* handler = new CanaryHandler(this, index);
+  XrdCl::XRootDStatus st = endpoint.fs->Stat(mCanaryPath, handler, timeout);
 
-    // Compute the MD5 hash
-    unsigned char digest[MD5_DIGEST_LENGTH];
-    MD5((unsigned char*) scope_file.c_str(), scope_file.length(),
-        (unsigned char*)&digest);
+  // If the request could not be sent the handler is never called
+  if (!st.IsOK())
+    handler->HandleResponse(new XrdCl::XRootDStatus(st), 0);
+}
 
-    // Now we need to 0 pad it to get the full 32 chars
-    char zero_pad[3];
-    zero_pad[2] = '\0';
-    std::string md5_string;
-    md5_string.reserve(32);
 
-    for (int i = 0; i < 16; i++)
-    {
-      sprintf(&zero_pad[0], "%02x", (unsigned int)digest[i]);
-      md5_string.append(zero_pad);
-    }
+//------------------------------------------------------------------------------
+// Account for the outcome of a canary stat
+//------------------------------------------------------------------------------
+void
+EosRucioCms::CanaryDone(int index, bool ok)
+{
+  EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(index);
 
-    RucioError.Emsg("Translate ", "MD5 string is: ", md5_string.c_str());
-    std::stringstream sstr;
-    sstr << "rucio/" << scope << "/" << md5_string.substr(0, 2) << "/" <<
-         md5_string.substr(2, 2) << "/" << file_name;
-    pfn = sstr.str();
-  }
-  else
+  if (!ok)
   {
-    RucioError.Emsg("Translate ", "File is not Rucio type");
+    endpoint.num_canary_errors++;
+    RucioError.Emsg("Canary", "Failed to stat canary path on EOS instance:",
+                    endpoint.instance.c_str(), mCanaryPath.c_str());
   }
 
-  return pfn;
+  if (endpoint.breaker.RecordCanary(ok))
+    LogBreaker(index, "canary stat");
+
+  endpoint.canary_in_flight = false;
 }
 
 
 //------------------------------------------------------------------------------
-// Compare method used to sort the list of space tokens by priority in
-// descending order
+// Log the state of the circuit breaker of an EOS endpoint
 //------------------------------------------------------------------------------
-bool
-EosRucioCms::CompareByPriority(std::pair<std::string, uint64_t>& first,
-                               std::pair<std::string, uint64_t>& second)
+void
+EosRucioCms::LogBreaker(int index, const char* reason)
 {
-  if (first.second > second.second) return true;
-  else return false;
+  EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(index);
+  std::string msg = "set the breaker for EOS instance " + endpoint.instance +
+                    " to " + EndpointSet::GetStateName(endpoint.breaker.GetState());
+  RucioError.Emsg("CircuitBreaker", reason, msg.c_str());
 }
 
 
 //------------------------------------------------------------------------------
-// Generate the full pfn path by concatenating the space tokens at the current
-// site with the translated lfn
+// Handle the reply of a ping to an uplink
 //------------------------------------------------------------------------------
-std::string
-EosRucioCms::GetValidPfn(std::string lfn)
+void
+EosRucioCms::UplinkPingHandler::HandleResponse(XrdCl::XRootDStatus* status,
+                                               XrdCl::AnyObject* response)
 {
-  bool found_file = false;
-  std::string pfn_full = "";
-  std::string pfn_partial = Translate(lfn);
+  bool ok = (status && status->IsOK());
+  delete status;
+  delete response;
+  mCms->UplinkPingDone(mUplink, ok, LatencyStats::NowUs() - mStartUs);
+  delete this;
+}
 
-  // If Rucio translation fails, we return an empty string
-  if (pfn_partial.empty())
-    return pfn_partial;
 
-  std::list< std::pair<std::string, uint64_t> > ordered_list;
-  mLockMap.ReadLock();  // -->
+//------------------------------------------------------------------------------
+// Send a ping to each uplink
+//------------------------------------------------------------------------------
+void
+EosRucioCms::PingUplinks()
+{
+  uint16_t timeout = static_cast<uint16_t>(mUplinkPing < 5 ? mUplinkPing : 5);
 
-  for (auto it = mMapSpace.begin(); it != mMapSpace.end(); ++it)
+  for (size_t i = 0; i < mUplinks.GetSize(); ++i)
   {
-    ordered_list.push_back(*it);
+    EndpointSet::Endpoint& uplink = mUplinks.Get(i);
+
+    // A ping which hangs is not doubled up
+    if (uplink.canary_in_flight.exchange(true))
+      continue;
+
+    uplink.num_canaries++;
+    UplinkPingHandler* handler = new UplinkPingHandler(this, i);
+    XrdCl::XRootDStatus st = uplink.fs->Ping(handler, timeout);
+
+    // If the request could not be sent the handler is never called
+    if (!st.IsOK())
+      handler->HandleResponse(new XrdCl::XRootDStatus(st), 0);
   }
+}
 
-  mLockMap.UnLock();    // <--
-  ordered_list.sort(EosRucioCms::CompareByPriority);
-  std::stringstream sstr;
-  XrdCl::URL url(mEosInstance);
-  XrdCl::FileSystem fs(url);
-  XrdCl::StatInfo* response = 0;
-  XrdCl::Status status;
 
-  for (auto it = ordered_list.begin(); it != ordered_list.end(); ++it)
+//------------------------------------------------------------------------------
+// Account for the outcome of a ping to an uplink
+//------------------------------------------------------------------------------
+void
+EosRucioCms::UplinkPingDone(int index, bool ok, uint64_t rtt_us)
+{
+  EndpointSet::Endpoint& uplink = mUplinks.Get(index);
+
+  if (ok)
   {
-    sstr << "Check in path: " << it->first << " with priority: " << it->second;
-    RucioError.Emsg("GetValidPfn", sstr.str().c_str());
-    sstr.str("");
-    sstr << it->first << pfn_partial;
-    pfn_full = sstr.str();
-    // Put a timeout of 5 seconds just to be on the safe side since by default
-    // if the file can not be found, the server requests a timeout of 120 seconds
-    status = fs.Stat(pfn_full, response, 5);
+    mUplinks.AddRtt(index, rtt_us);
+  }
+  else
+  {
+    uplink.num_canary_errors++;
+    RucioError.Emsg("PingUplinks", "Failed to ping uplink:",
+                    uplink.instance.c_str());
+  }
 
-    if (status.IsOK() && response)
-    {
-      RucioError.Emsg("GetValidPfn", "Stat successful for pfn:", pfn_full.c_str());
+  if (uplink.breaker.RecordCanary(ok))
+  {
+    std::string msg = "set the breaker for uplink " + uplink.instance + " to " +
+                      EndpointSet::GetStateName(uplink.breaker.GetState());
+    RucioError.Emsg("CircuitBreaker", "uplink ping", msg.c_str());
+  }
 
-      if (response->TestFlags(XrdCl::StatInfo::IsReadable |
-                              XrdCl::StatInfo::IsWritable))
-      {
-        // Update the map value
-        mLockMap.WriteLock();    // -->
-        mMapSpace[it->first] = it->second + 1;
-        mLockMap.UnLock();      // <--
-        found_file = true;
-        break;
-      }
+  uplink.canary_in_flight = false;
+}
+
+
+//------------------------------------------------------------------------------
+// Ping the EOS instance
+//------------------------------------------------------------------------------
+bool
+EosRucioCms::PingEos()
+{
+  bool all_ok = true;
+
+  for (size_t i = 0; i < mEosEndpoints.GetSize(); ++i)
+  {
+    EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(i);
+    XrdCl::XRootDStatus st = endpoint.fs->Ping(5);
 
-      delete response;
-      response = 0;
+    if (!st.IsOK())
+    {
+      mNumPingErrors++;
+      RucioError.Emsg("PingEos", "Failed to ping EOS instance:",
+                      endpoint.instance.c_str(), st.ToString().c_str());
+      all_ok = false;
     }
   }
 
-  if (!found_file)
-    pfn_full.clear();
+  return all_ok;
+}
+
+
+//------------------------------------------------------------------------------
+// Handle the reply of a keepalive ping
+//------------------------------------------------------------------------------
+void
+EosRucioCms::KeepaliveHandler::HandleResponse(XrdCl::XRootDStatus* status,
+                                              XrdCl::AnyObject* response)
+{
+  bool ok = (status && status->IsOK());
+  std::string error = (ok || !status) ? "" : status->ToString();
+  delete status;
+  delete response;
+  mCms->KeepaliveDone(mEndpoint, ok, error);
+  delete this;
+}
+
+
+//------------------------------------------------------------------------------
+// Send a keepalive ping to an EOS endpoint
+//------------------------------------------------------------------------------
+void
+EosRucioCms::SendKeepalive(int index)
+{
+  EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(index);
+
+  // A ping which hangs is not doubled up and a running canary stat already
+  // keeps the connection busy
+  if (endpoint.canary_in_flight.exchange(true))
+    return;
+
+  KeepaliveHandler* handler = new KeepaliveHandler(this, index);
+  XrdCl::XRootDStatus st = endpoint.fs->Ping(handler, 5);
+
+  // If the request could not be sent the handler is never called
+  if (!st.IsOK())
+    handler->HandleResponse(new XrdCl::XRootDStatus(st), 0);
+}
+
+
+//------------------------------------------------------------------------------
+// Account for the outcome of a keepalive ping
+//------------------------------------------------------------------------------
+void
+EosRucioCms::KeepaliveDone(int index, bool ok, const std::string& error)
+{
+  EndpointSet::Endpoint& endpoint = mEosEndpoints.Get(index);
+
+  if (!ok)
+  {
+    mNumPingErrors++;
+    RucioError.Emsg("PingEos", "Failed to ping EOS instance:",
+                    endpoint.instance.c_str(), error.c_str());
+  }
+
+  if (endpoint.breaker.RecordCanary(ok))
+    LogBreaker(index, "keepalive ping");
 
-  return pfn_full;
+  endpoint.canary_in_flight = false;
 }
 
 
@@ -847,3 +3349,65 @@ EosRucioCms::ReadLocalJson(std::string path)
 }
 
 
+//------------------------------------------------------------------------------
+// Handle the replicas of a file returned by an EOS endpoint
+//------------------------------------------------------------------------------
+void
+EosRucioCms::ReplicaLocateHandler::HandleResponse(XrdCl::XRootDStatus* status,
+                                                  XrdCl::AnyObject* response)
+{
+  XrdCl::LocationInfo* info = 0;
+
+  if (status && status->IsOK() && response)
+    response->Get(info);
+
+  mCms->ReplicasDone(mPfn, status, info);
+  delete status;
+  delete response;
+  delete this;
+}
+
+
+//------------------------------------------------------------------------------
+// Store the replicas returned by an EOS endpoint for a file
+//------------------------------------------------------------------------------
+void
+EosRucioCms::ReplicasDone(const std::string& pfn, XrdCl::XRootDStatus* status,
+                          XrdCl::LocationInfo* info)
+{
+  std::vector<ReplicaCache::Replica> replicas;
+
+  if (info)
+  {
+    for (XrdCl::LocationInfo::Iterator it = info->Begin(); it != info->End(); ++it)
+    {
+      // Only the storage nodes which have the file online can serve it, the
+      // EOS endpoint itself may show up as a manager
+      if (it->GetType() != XrdCl::LocationInfo::ServerOnline)
+        continue;
+
+      const std::string& address = it->GetAddress();
+      size_t pos = address.rfind(':');
+
+      if ((pos == std::string::npos) || (pos == 0))
+        continue;
+
+      ReplicaCache::Replica replica;
+      replica.host = address.substr(0, pos);
+      replica.port = atoi(address.c_str() + pos + 1);
+
+      if (replica.port > 0)
+        replicas.push_back(replica);
+    }
+  }
+  else
+  {
+    mNumReplicaErrors++;
+    RucioError.Emsg("ReplicasDone", "Failed to locate the replicas of pfn=",
+                    pfn.c_str(), (status ? status->ToString().c_str() : ""));
+  }
+
+  // Without replicas the entry keeps the file on the EOS endpoint until it
+  // expires instead of asking again at every locate
+  mReplicas->Put(pfn, replicas);
+}
@@ -27,11 +27,39 @@
 /*----------------------------------------------------------------------------*/
 #include "XrdCms/XrdCmsClient.hh"
 #include "XrdSys/XrdSysPthread.hh"
+#include "PfnProbe.hh"
+#include "ProbeTimer.hh"
+#include "StatDispatcher.hh"
+#include "QosTable.hh"
+#include "EndpointSet.hh"
+#include "LatencyStats.hh"
+#include "PfnCache.hh"
+#include "ReplicaCache.hh"
+#include "SingleFlight.hh"
+#include "TokenTable.hh"
+#include "ScopeTable.hh"
+#include "RouteTrie.hh"
 /*----------------------------------------------------------------------------*/
 #include <string>
 #include <map>
+#include <vector>
+#include <atomic>
+#include <openssl/md5.h>
 /*----------------------------------------------------------------------------*/
 
+//------------------------------------------------------------------------------
+//! Rucio name obtained from an lfn. The scope and the file name are views into
+//! the original lfn buffer, therefore they are valid only as long as the lfn.
+//------------------------------------------------------------------------------
+struct RucioName
+{
+  const char* scope; ///< start of the scope inside the lfn
+  size_t scope_len; ///< length of the scope
+  const char* name; ///< start of the file name inside the lfn
+  size_t name_len; ///< length of the file name
+  unsigned char digest[MD5_DIGEST_LENGTH]; ///< MD5 of "scope:name"
+};
+
 //------------------------------------------------------------------------------
 //! Class EosRucioCms used to the Rucio translation for the files in EOS
 //------------------------------------------------------------------------------
@@ -113,60 +141,728 @@ class EosRucioCms: public XrdCmsClient
     };
 
 
+    //--------------------------------------------------------------------------
+    //! Maximum length of a pfn produced by the translation kernel including
+    //! the terminating null character
+    //--------------------------------------------------------------------------
+    static const size_t sPfnMaxLen = 4096;
+
+    //--------------------------------------------------------------------------
+    //! Error codes returned by the translation kernel
+    //--------------------------------------------------------------------------
+    enum TranslateError
+    {
+      eNotRucio = -1, ///< lfn does not start with the Rucio prefix
+      eNoScope = -2, ///< scope or file name could not be extracted
+      eTooLong = -3 ///< pfn does not fit in the supplied buffer
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Translate logical file name to physical file name using the Rucio alg.
+    //! This is the allocation-free kernel used on the Locate path: it does no
+    //! heap allocation and no logging, the pfn is written in the caller buffer.
+    //!
+    //! @param lfn logical file name (does not need to be null terminated)
+    //! @param lfn_len length of the logical file name
+    //! @param rname Rucio name extracted from the lfn (views into lfn)
+    //! @param pfn buffer where the null terminated pfn is written
+    //! @param pfn_size size of the pfn buffer
+    //!
+    //! @return length of the pfn without the null character, or one of the
+    //!         negative TranslateError values
+    //!
+    //--------------------------------------------------------------------------
+    static int Translate(const char* lfn, size_t lfn_len, RucioName& rname,
+                         char* pfn, size_t pfn_size);
+
+
+    //--------------------------------------------------------------------------
+    //! Translate logical file name to physical file name using the Rucio alg.
+    //!
+    //! @param lfn logical file name
+    //!
+    //! @return translated physical file name
+    //!
+    //--------------------------------------------------------------------------
+    std::string Translate(std::string lfn);
+
+
+    //--------------------------------------------------------------------------
+    //! Translate a list of Rucio keys to physical file names in one pass. The
+    //! MD5 digests are computed several keys at a time in the SIMD lanes, see
+    //! RucioMd5. The output is identical to the one of the scalar Translate.
+    //!
+    //! @param keys list of "scope:name" keys
+    //! @param pfns list of translated pfns in the same order as the keys. An
+    //!        empty string marks a key from which the scope and/or the file
+    //!        name could not be extracted.
+    //!
+    //! @return number of keys translated successfully
+    //!
+    //--------------------------------------------------------------------------
+    static size_t TranslateBatch(const std::vector<std::string>& keys,
+                                 std::vector<std::string>& pfns);
+
   private:
 
-    XrdSysRWLock mLockMap; ///< rw lock used to sync access to the map
+    //--------------------------------------------------------------------------
+    //! Existence check of one lfn, shared by the synchronous and the
+    //! asynchronous locate
+    //--------------------------------------------------------------------------
+    struct PfnCheck
+    {
+      PfnCheck(): predicted(-1), flight(0), probe(0), start_us(0), qos(-1),
+        client(0), qos_admitted(false), endpoint(-1), breaker_trial(false),
+        verify(false), hint(-1), tag(-1)
+      { }
+
+      std::string lfn; ///< lfn of the check, the Rucio name points into it
+      RucioName rname; ///< Rucio name of the lfn
+      char pfn_partial[sPfnMaxLen]; ///< translated pfn without space token
+      std::vector<int> order; ///< token indices in probing order
+      int predicted; ///< token predicted from the scope, -1 if none
+      SingleFlight::Flight* flight; ///< check shared with concurrent locates
+      PfnProbe* probe; ///< probe of the check if this locate leads it
+      uint64_t start_us; ///< time at which the probe was admitted
+      int qos; ///< QoS class of the client, -1 if not limited
+      uint32_t client; ///< hash of the client for its rate limit
+      bool qos_admitted; ///< true if the check holds a slot of its class
+      int endpoint; ///< EOS endpoint probed, -1 if none was acquired
+      bool breaker_trial; ///< true if the check is the trial of its breaker
+      bool verify; ///< true if the file is stated even in an authoritative token
+      int hint; ///< token named by the client, -1 if none
+      int tag; ///< flight tag, the hint if only the hinted token is probed
+    };
+
+    //! Use of the space token hint given by the clients
+    enum HintMode
+    {
+      eHintOff, ///< the hint is ignored
+      eHintFirst, ///< the hinted token is probed first
+      eHintOnly ///< only the hinted token is probed
+    };
+
+    //! State of a check after BeginCheck
+    enum CheckState
+    {
+      eCheckDone, ///< outcome already known
+      eCheckFollow, ///< waits for the check of a concurrent locate
+      eCheckProbe ///< the probe must be started
+    };
+
+    class AsyncLocate;
+
+    //--------------------------------------------------------------------------
+    //! Handler of the reply of a canary stat
+    //--------------------------------------------------------------------------
+    class CanaryHandler: public XrdCl::ResponseHandler
+    {
+      public:
+
+        CanaryHandler(EosRucioCms* cms, int endpoint):
+          mCms(cms), mEndpoint(endpoint)
+        { }
+
+        virtual ~CanaryHandler() { }
+
+        virtual void HandleResponse(XrdCl::XRootDStatus* status,
+                                    XrdCl::AnyObject* response);
+
+      private:
+
+        EosRucioCms* mCms; ///< plugin which sent the canary
+        int mEndpoint; ///< EOS endpoint stated
+    };
+
+    //--------------------------------------------------------------------------
+    //! Handler of the reply of a keepalive ping to an EOS endpoint
+    //--------------------------------------------------------------------------
+    class KeepaliveHandler: public XrdCl::ResponseHandler
+    {
+      public:
+
+        KeepaliveHandler(EosRucioCms* cms, int endpoint):
+          mCms(cms), mEndpoint(endpoint)
+        { }
+
+        virtual ~KeepaliveHandler() { }
+
+        virtual void HandleResponse(XrdCl::XRootDStatus* status,
+                                    XrdCl::AnyObject* response);
+
+      private:
+
+        EosRucioCms* mCms; ///< plugin which sent the ping
+        int mEndpoint; ///< EOS endpoint pinged
+    };
+
+    //--------------------------------------------------------------------------
+    //! Handler of the reply of a ping measuring the round trip time of an
+    //! uplink
+    //--------------------------------------------------------------------------
+    class UplinkPingHandler: public XrdCl::ResponseHandler
+    {
+      public:
+
+        UplinkPingHandler(EosRucioCms* cms, int uplink):
+          mCms(cms), mUplink(uplink), mStartUs(LatencyStats::NowUs())
+        { }
+
+        virtual ~UplinkPingHandler() { }
+
+        virtual void HandleResponse(XrdCl::XRootDStatus* status,
+                                    XrdCl::AnyObject* response);
+
+      private:
+
+        EosRucioCms* mCms; ///< plugin which sent the ping
+        int mUplink; ///< uplink pinged
+        uint64_t mStartUs; ///< time at which the ping was sent
+    };
+
+    //--------------------------------------------------------------------------
+    //! Handler of the request asking an EOS endpoint for the replicas of a file
+    //--------------------------------------------------------------------------
+    class ReplicaLocateHandler: public XrdCl::ResponseHandler
+    {
+      public:
+
+        ReplicaLocateHandler(EosRucioCms* cms, const std::string& pfn):
+          mCms(cms), mPfn(pfn)
+        { }
+
+        virtual ~ReplicaLocateHandler() { }
+
+        virtual void HandleResponse(XrdCl::XRootDStatus* status,
+                                    XrdCl::AnyObject* response);
+
+      private:
+
+        EosRucioCms* mCms; ///< plugin which sent the request
+        std::string mPfn; ///< full pfn of the file in EOS
+    };
 
     ///! map between space tokend and requests successfully statisfied
     ///! i.e. files for which the stat was succcessful in the corresponding
-    ///! space token.
+    ///! space token. Only used during the configuration, afterwards the
+    ///! priorities are kept up to date in mTokens.
     std::map<std::string, uint64_t> mMapSpace;
 
     std::string mSiteName; ///< site parameter for the Rucio translation
     std::string mJsonFile; ///< local json file for the Rucio translation
     std::string mAgisSite; ///< AGIS site for Rucio translation
-    std::string mEosInstance; ///< EOS instance host:port
     std::string mEosHost; ///< EOS host where requests are forwarded
     unsigned int mEosPort; ///< EOS port where requestts are forwarded
-    std::string mUplinkInstance; ///< Uplink instance host:port
+    EndpointSet mEosEndpoints; ///< EOS endpoints serving the namespace
     std::string mUplinkHost; ///< uplink host address where failed req are redirected
     unsigned int mUplinkPort; ///< uplink host port where failed req are redirected
+    EndpointSet mUplinks; ///< uplink redirectors for the files not in EOS
+    unsigned int mUplinkPing; ///< seconds between pings to the uplinks
+    PfnProbe::Mode mProbeMode; ///< mode used for the existence checks in EOS
+    unsigned int mHedgePct; ///< latency percentile used as hedge delay
+    unsigned int mReportInterval; ///< seconds between statistics reports
+    unsigned int mLocateDeadline; ///< time budget in ms of a locate, 0 disables
+    unsigned int mKeepAlive; ///< seconds between pings to EOS, 0 disables
+    unsigned int mMaxChecks; ///< max existence checks in flight, 0 disables
+    unsigned int mTokenLimit; ///< max outstanding stats per token, 0 disables
+    unsigned int mBreakerFailures; ///< failed checks opening the breaker
+    unsigned int mBreakerOpen; ///< seconds the breaker stays open at first
+    std::string mCanaryPath; ///< path stated to monitor EOS, empty disables
+    unsigned int mCanaryInterval; ///< seconds between canary stats
+    unsigned int mQueueSize; ///< max existence checks waiting for admission
+    unsigned int mQueueWait; ///< max time in ms a check waits for admission
+    unsigned int mCacheSize; ///< memory limit of the existence cache in MB
+    unsigned int mCacheTtl; ///< seconds a file found in EOS stays cached
+    unsigned int mCacheNegTtl; ///< seconds a file not in EOS stays cached
+    PfnCache* mCache; ///< existence cache, 0 if disabled
+    unsigned int mHalfLife; ///< half life in seconds of the token hits
+    double mLatWeight; ///< weight of the token stat latency in the score
+    double mErrWeight; ///< weight of the token stat error rate in the score
+    unsigned int mScopeEntries; ///< entries of the scope prediction table
+    ScopeTable* mScopes; ///< scope to token prediction, 0 if disabled
+    RouteTrie mRoutes; ///< static scope to token routing rules
+    std::vector<bool> mAuthoritative; ///< tokens holding all their files
+    HintMode mHintMode; ///< use of the space token hint of the clients
+    std::map<std::string, int> mHintTokens; ///< token index by hint value
+    SingleFlight mInFlight; ///< existence checks in progress
+    bool mAsyncLocate; ///< if true, locates are answered through a callback
+    bool mMetalink; ///< if true, files in EOS are answered with a metalink
+    bool mFstRedirect; ///< if true, hot files are redirected to their FST
+    unsigned int mReplicaTtl; ///< seconds the replicas of a file are kept
+    unsigned int mReplicaEntries; ///< max files in the replica cache
+    unsigned int mReplicaHot; ///< locates of a file before its replicas are fetched
+    ReplicaCache* mReplicas; ///< replicas of the hot files, 0 if disabled
+    ProbeTimer mProbeTimer; ///< timers of the asynchronous probes
+    StatDispatcher mDispatcher; ///< admission of the existence checks
+    QosTable mQos; ///< QoS classes of the clients
+
+    ///! space tokens with their probing order, populated in Configure. The
+    ///! existence cache stores token indices in it.
+    TokenTable mTokens;
+    LatencyStats mProbeLatency; ///< latency of the complete existence checks
+    std::atomic<uint64_t> mNumProbes; ///< number of existence checks
+    std::atomic<uint64_t> mNumStats; ///< number of stat requests sent to EOS
+    std::atomic<uint64_t> mNumHedged; ///< number of hedged stat requests
+    std::atomic<uint64_t> mNumExpired; ///< existence checks which hit the deadline
+    std::atomic<uint64_t> mNumPingErrors; ///< failed pings to EOS
+    std::atomic<uint64_t> mNumCoalesced; ///< locates which joined another check
+    std::atomic<uint64_t> mNumPredicted; ///< files found with a scope prediction
+    std::atomic<uint64_t> mNumMispredicted; ///< ... not in the predicted token
+    std::atomic<uint64_t> mNumAsync; ///< locates answered through a callback
+    std::atomic<int64_t> mNumPending; ///< ... whose callback is still pending
+    std::atomic<uint64_t> mNumMetalink; ///< locates answered with a metalink
+    std::atomic<uint64_t> mNumAuthoritative; ///< locates answered without stat
+    std::atomic<uint64_t> mNumTried; ///< locates which already tried EOS
+    std::atomic<uint64_t> mNumTriedErased; ///< ... whose cache entry was dropped
+    std::atomic<uint64_t> mNumHints; ///< locates with a known token hint
+    std::atomic<uint64_t> mNumHintUnknown; ///< ... with an unknown token hint
+    std::atomic<uint64_t> mNumHintProbes; ///< existence checks with a hint
+    std::atomic<uint64_t> mNumHintHits; ///< ... which found the file there
+    std::atomic<uint64_t> mNumReplicaErrors; ///< failed replica requests
+
+    XrdSysCondVar mMaintenanceCond; ///< cond. var. to wake up maintenance thread
+    bool mStopMaintenance; ///< flag to stop the maintenance thread
+    bool mMaintenanceRunning; ///< true if the maintenance thread is running
+    pthread_t mMaintenanceTid; ///< maintenance thread id
 
     //--------------------------------------------------------------------------
     //! Generate the full pfn path by concatenating the space tokens at the
     //! current site with the translated lfn.
     //!
     //! @param pfn_name parital pfn name obtained using the Translate method
+    //! @param refresh if true, the existence cache is not consulted but the
+    //!        outcome of the check still replaces the cached one
+    //! @param qos QoS class of the client, -1 if not limited
+    //! @param client hash of the client
+    //! @param verify if true, the file is stated even in an authoritative token
+    //! @param hint space token named by the client, -1 if none
     //!
-    //! @return full pfn name
+    //! @return full pfn name and EOS endpoint which confirmed it
     //!
     //--------------------------------------------------------------------------
-    std::string GetValidPfn(std::string pfn_partial);
+    SingleFlight::Result GetValidPfn(std::string pfn_partial,
+                                     bool refresh = false, int qos = -1,
+                                     uint32_t client = 0, bool verify = false,
+                                     int hint = -1);
 
 
     //--------------------------------------------------------------------------
-    //! Translate logical file name to physical file name using the Rucio alg.
+    //! Check if a host is in the tried list of a client. The host names of
+    //! the tried list may lack the domain or carry the port.
+    //!
+    //! @param tried comma separated list of hosts from the tried opaque
+    //! @param host full host name
+    //!
+    //! @return true if the host was tried, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool IsHostTried(const char* tried, const std::string& host);
+
+
+    //--------------------------------------------------------------------------
+    //! Check if a client already tried an EOS endpoint or one of the storage
+    //! nodes holding the cached replicas of the file
     //!
+    //! @param tried comma separated list of hosts from the tried opaque
     //! @param lfn logical file name
     //!
-    //! @return translated physical file name
+    //! @return true if EOS was tried, otherwise false
     //!
     //--------------------------------------------------------------------------
-    std::string Translate(std::string lfn);
+    bool IsEosTried(const char* tried, const char* lfn);
+
+
+    //--------------------------------------------------------------------------
+    //! Drop the cached entries which sent to EOS a client which failed there,
+    //! i.e. the existence of the file and its replicas
+    //!
+    //! @param lfn logical file name
+    //! @param tident client trace identifier
+    //! @param triedrc reason given by the client, may be 0
+    //!
+    //--------------------------------------------------------------------------
+    void DropTried(const char* lfn, const char* tident, const char* triedrc);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the space token named by the hint of a client, either the path of
+    //! the token or its last component in any case e.g. "atlasdatadisk"
+    //!
+    //! @param hint value of the eosrucio.token opaque
+    //!
+    //! @return index of the space token, -1 if unknown
+    //!
+    //--------------------------------------------------------------------------
+    int GetHintToken(const char* hint) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Start the existence check of an lfn: translate it, trust the space
+    //! token probed first if authoritative, look it up in the cache, join a
+    //! concurrent check or set up the probe of the space tokens
+    //!
+    //! @param check check to be initialised
+    //! @param lfn logical file name
+    //! @param refresh if true, the existence cache is not consulted
+    //! @param result outcome if already known
+    //!
+    //! @return state of the check
+    //!
+    //--------------------------------------------------------------------------
+    CheckState BeginCheck(PfnCheck& check, const char* lfn, bool refresh,
+                          SingleFlight::Result& result);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the space token always probed first for a Rucio name, i.e. the
+    //! first one of its routing rule. The order given by the scores and the
+    //! scope prediction changes over time and is not taken into account.
+    //!
+    //! @param route routing rule matching the scope of the name, 0 if none
+    //!
+    //! @return index of the space token, -1 if it depends on the scores
+    //!
+    //--------------------------------------------------------------------------
+    int GetFirstToken(const RouteTrie::Rule* route);
+
+
+    //--------------------------------------------------------------------------
+    //! Wait synchronously for the outcome of a check which is not done
+    //!
+    //! @param check check started by BeginCheck
+    //! @param state state returned by BeginCheck
+    //!
+    //! @return outcome of the check, empty pfn if not found
+    //!
+    //--------------------------------------------------------------------------
+    SingleFlight::Result WaitCheck(PfnCheck& check, CheckState state);
+
+
+    //--------------------------------------------------------------------------
+    //! Account for the outcome of a completed probe, update the cache and
+    //! wake up the concurrent locates of the same file
+    //!
+    //! @param check check whose probe is done, the probe is released
+    //!
+    //! @return outcome of the check, empty pfn if not found
+    //!
+    //--------------------------------------------------------------------------
+    SingleFlight::Result EndCheck(PfnCheck& check);
+
+
+    //--------------------------------------------------------------------------
+    //! Admit an existence check in the QoS class of its client
+    //!
+    //! @param check check whose probe is not started yet
+    //!
+    //! @return true if the check can go on, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool AdmitQos(PfnCheck& check);
+
+
+    //--------------------------------------------------------------------------
+    //! Give up an existence check which was not admitted and wake up the
+    //! concurrent locates of the same file
+    //!
+    //! @param check check whose probe was not started, the probe and the EOS
+    //!        endpoint are released
+    //! @param reason reason logged
+    //!
+    //! @return empty outcome so that the locate goes to the uplink
+    //!
+    //--------------------------------------------------------------------------
+    SingleFlight::Result ShedCheck(PfnCheck& check, const char* reason);
+
+
+    //--------------------------------------------------------------------------
+    //! Build the response of a locate from the outcome of the check
+    //!
+    //! @param path requested path
+    //! @param result outcome of the check, empty pfn if not found
+    //! @param tident client trace identifier
+    //! @param metalink if true, the client can follow a metalink redirection
+    //! @param direct if true, the client can be sent to the FST of the file
+    //! @param target host, metalink or opaque data of the response
+    //! @param code port of the redirection, -1 for a metalink
+    //!
+    //! @return SFS_REDIRECT or SFS_DATA
+    //!
+    //--------------------------------------------------------------------------
+    int GetResponse(const char* path, const SingleFlight::Result& result,
+                    const char* tident, bool metalink, bool direct,
+                    std::string& target, int& code);
+
+
+    //--------------------------------------------------------------------------
+    //! Get a storage node holding a replica of a file found in EOS. If the
+    //! replicas of the file are not known, they are requested from the EOS
+    //! endpoint for the next locates.
+    //!
+    //! @param result outcome of the check with the pfn found in EOS
+    //! @param replica set to the storage node if found
+    //!
+    //! @return true if a replica was found, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool GetReplica(const SingleFlight::Result& result,
+                    ReplicaCache::Replica& replica);
+
+
+    //--------------------------------------------------------------------------
+    //! Store the replicas returned by an EOS endpoint for a file
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //! @param status status of the request
+    //! @param info locations of the file, 0 if the request failed
+    //!
+    //--------------------------------------------------------------------------
+    void ReplicasDone(const std::string& pfn, XrdCl::XRootDStatus* status,
+                      XrdCl::LocationInfo* info);
+
+
+    //--------------------------------------------------------------------------
+    //! Build the metalink listing the EOS host holding the file first and
+    //! the uplink second, so that the client fails over without coming back
+    //!
+    //! @param path requested path
+    //! @param pfn full pfn of the file in EOS
+    //! @param host host in EOS to which the client is sent first
+    //! @param port port of the host
+    //! @param buf buffer where the null terminated metalink is written
+    //! @param size size of the buffer
+    //!
+    //! @return length of the metalink, 0 if it does not fit in the buffer
+    //!
+    //--------------------------------------------------------------------------
+    size_t BuildMetalink(const char* path, const std::string& pfn,
+                         const std::string& host, int port, char* buf,
+                         size_t size);
+
+
+    //--------------------------------------------------------------------------
+    //! Append data to a bounded buffer
+    //!
+    //! @param buf buffer
+    //! @param size size of the buffer
+    //! @param len length of the data in the buffer, updated
+    //! @param data data to append
+    //! @param data_len length of the data to append
+    //!
+    //! @return true if the data fits, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool AppendBuf(char* buf, size_t size, size_t& len, const char* data,
+                          size_t data_len);
+
+
+    //--------------------------------------------------------------------------
+    //! Append a string to an XML document escaping the special characters
+    //!
+    //! @param buf buffer holding the document
+    //! @param size size of the buffer
+    //! @param len length of the document, updated
+    //! @param data null terminated string to append
+    //!
+    //! @return true if the string fits, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool AppendXml(char* buf, size_t size, size_t& len, const char* data);
+
+
+    //--------------------------------------------------------------------------
+    //! Log the reason for which the translation kernel failed
+    //!
+    //! @param retc negative value returned by the translation kernel
+    //!
+    //--------------------------------------------------------------------------
+    static void LogTranslateError(int retc);
+
+
+    //--------------------------------------------------------------------------
+    //! Parse unsigned integer configuration value
+    //!
+    //! @param tag configuration tag used for error messages
+    //! @param val value to be parsed
+    //! @param value parsed value
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool ParseUnsigned(const char* tag, const char* val,
+                              unsigned int& value);
+
+
+    //--------------------------------------------------------------------------
+    //! Parse non-negative floating point configuration value
+    //!
+    //! @param tag configuration tag used for error messages
+    //! @param val value to be parsed
+    //! @param value parsed value
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool ParseDouble(const char* tag, const char* val, double& value);
+
+
+    //--------------------------------------------------------------------------
+    //! Parse parameter of a QoS class i.e. a limit or a condition on the
+    //! client identity given as key=value
+    //!
+    //! @param param parameter to be parsed
+    //! @param limits updated with a limit
+    //! @param matches extended with a condition
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool ParseQosParam(const char* param, QosTable::Limits& limits,
+                              std::vector<QosTable::Match>& matches);
+
+
+    //--------------------------------------------------------------------------
+    //! Parse endpoint given as host:port
+    //!
+    //! @param tag configuration tag used for error messages
+    //! @param val value to be parsed
+    //! @param host parsed host name
+    //! @param port parsed port
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool ParseHostPort(const char* tag, const char* val,
+                              std::string& host, unsigned int& port);
+
+
+    //--------------------------------------------------------------------------
+    //! Parse parameter of an EOS endpoint or of an uplink i.e. weight=<n> or
+    //! role=primary|backup
+    //!
+    //! @param param parameter to be parsed
+    //! @param weight updated with the weight
+    //! @param role updated with the role
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool ParseEndpointParam(const char* param, unsigned int& weight,
+                                   EndpointSet::Role& role);
+
+
+    //--------------------------------------------------------------------------
+    //! Start maintenance thread
+    //!
+    //! @param arg EosRucioCms object
+    //!
+    //--------------------------------------------------------------------------
+    static void* StartMaintenance(void* arg);
+
+
+    //--------------------------------------------------------------------------
+    //! Maintenance loop running the periodic tasks of the plugin
+    //--------------------------------------------------------------------------
+    void Maintenance();
+
+
+    //--------------------------------------------------------------------------
+    //! Log the statistics about the existence checks done in EOS
+    //--------------------------------------------------------------------------
+    void ReportStats();
+
+
+    //--------------------------------------------------------------------------
+    //! Send a canary stat to an EOS endpoint unless one is still running
+    //!
+    //! @param index index of the EOS endpoint
+    //!
+    //--------------------------------------------------------------------------
+    void SendCanary(int index);
+
+
+    //--------------------------------------------------------------------------
+    //! Account for the outcome of a canary stat
+    //!
+    //! @param index index of the EOS endpoint
+    //! @param ok true if EOS replied
+    //!
+    //--------------------------------------------------------------------------
+    void CanaryDone(int index, bool ok);
+
+
+    //--------------------------------------------------------------------------
+    //! Log the state of the circuit breaker of an EOS endpoint after a change
+    //!
+    //! @param index index of the EOS endpoint
+    //! @param reason what caused the change
+    //!
+    //--------------------------------------------------------------------------
+    void LogBreaker(int index, const char* reason);
+
+
+    //--------------------------------------------------------------------------
+    //! Send a ping to each uplink, unless one is still running, to measure
+    //! their round trip time and detect the dead ones
+    //--------------------------------------------------------------------------
+    void PingUplinks();
+
+
+    //--------------------------------------------------------------------------
+    //! Account for the outcome of a ping to an uplink
+    //!
+    //! @param index index of the uplink
+    //! @param ok true if the uplink replied
+    //! @param rtt_us round trip time in microseconds
+    //!
+    //--------------------------------------------------------------------------
+    void UplinkPingDone(int index, bool ok, uint64_t rtt_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Ping the EOS endpoints and wait for the replies to set up the
+    //! connections used by the existence checks
+    //!
+    //! @return true if all the endpoints replied, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool PingEos();
+
+
+    //--------------------------------------------------------------------------
+    //! Send a ping to an EOS endpoint to keep alive its connection, unless a
+    //! canary stat or ping to it is still running
+    //!
+    //! @param index index of the EOS endpoint
+    //!
+    //--------------------------------------------------------------------------
+    void SendKeepalive(int index);
+
+
+    //--------------------------------------------------------------------------
+    //! Account for the outcome of a keepalive ping
+    //!
+    //! @param index index of the EOS endpoint
+    //! @param ok true if EOS replied
+    //! @param error error of the ping if it failed
+    //!
+    //--------------------------------------------------------------------------
+    void KeepaliveDone(int index, bool ok, const std::string& error);
 
 
     //--------------------------------------------------------------------------
-    //! Compare method used to sort the list of space tokens by priority
+    //! Write the pfn corresponding to a Rucio name whose digest is already
+    //! computed: rucio/<scope>/<hex0>/<hex1>/<name>
     //!
-    //! @param first first element
-    //! @param second second element
+    //! @param rname Rucio name
+    //! @param pfn buffer where the null terminated pfn is written
+    //! @param pfn_size size of the pfn buffer
     //!
-    //! @return true if the first argument goes before the second one argument
-    //!         in the strict weak ordering it defines, and falso otherwise.
+    //! @return length of the pfn without the null character, or eTooLong
     //!
     //--------------------------------------------------------------------------
-    static bool CompareByPriority(std::pair<std::string, uint64_t>& first,
-                                  std::pair<std::string, uint64_t>& second);
+    static int FormatPfn(const RucioName& rname, char* pfn, size_t pfn_size);
 
 
     //--------------------------------------------------------------------------
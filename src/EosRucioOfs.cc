@@ -23,12 +23,16 @@
 
 /*----------------------------------------------------------------------------*/
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
+#include <sys/stat.h>
 /*----------------------------------------------------------------------------*/
 #include "EosRucioOfs.hh"
 /*----------------------------------------------------------------------------*/
 #include "XrdOuc/XrdOucTrace.hh"
 #include "XrdOuc/XrdOucString.hh"
+#include "XrdOuc/XrdOucEnv.hh"
 #include "XrdOss/XrdOssApi.hh"
 #include "XrdCl/XrdClFileSystem.hh"
 /*----------------------------------------------------------------------------*/
@@ -71,7 +75,6 @@ extern "C"
 //------------------------------------------------------------------------------
 EosRucioOfs::EosRucioOfs():
   XrdOfs(),
-  mUplinkInstance(""),
   mUplinkHost(""),
   mUplinkPort(0)
 {
@@ -89,7 +92,8 @@ EosRucioOfs::~EosRucioOfs()
 
 
 //------------------------------------------------------------------------------
-// Configure routine which just needs to read the extra tag eosrucio.uphost
+// Configure routine which just needs to read the extra tags eosrucio.uphost,
+// eosrucio.upport and eosrucio.upendpoint
 //------------------------------------------------------------------------------
 int
 EosRucioOfs::Configure(XrdSysError& error)
@@ -169,32 +173,49 @@ EosRucioOfs::Configure(XrdSysError& error)
             }
           }
         }
+
+        // Get additional uplink, only its host:port matters here
+        option_tag = "upendpoint";
+
+        if (!strncmp(var, option_tag.c_str(), option_tag.length()))
+        {
+          if (!(val = Config.GetToken()))
+            error.Emsg("Configure ", "No uplink endpoint specified");
+          else if (XrdCl::URL(val).IsValid())
+            mUplinks.insert(val);
+          else
+            error.Emsg("Configure ", "Uplink endpoint url is not valid", val);
+        }
       }
     }
   }
 
-  // Check that the uplink redirect is valid
-  if (mUplinkHost.empty() || (mUplinkPort == 0))
-  {
-    error.Emsg("Configure", "Uplink instance value missing/invalid",
-               "Example \"eosrucio.uphost atlas-xrd-eu.cern.ch\"",
-               "        \"eosrucio.upport 1094\"");
-    NoGo = 1;
-    return NoGo;
-  }
-  else
+  // The uphost and upport pair is an uplink like the ones given with
+  // upendpoint
+  if (!mUplinkHost.empty() && mUplinkPort)
   {
     std::stringstream sstr;
     sstr << mUplinkHost << ":" << mUplinkPort;
-    mUplinkInstance = sstr.str();
-    XrdCl::URL url(mUplinkInstance);
+    XrdCl::URL url(sstr.str());
 
     if (!url.IsValid())
     {
       error.Emsg("Configure ", "Uplink redirect url is not valid");
-      mUplinkInstance = "";
       NoGo = 1;
     }
+    else
+    {
+      mUplinks.insert(sstr.str());
+    }
+  }
+
+  // Check that there is at least one uplink
+  if (mUplinks.empty())
+  {
+    error.Emsg("Configure", "Uplink instance value missing/invalid",
+               "Example \"eosrucio.uphost atlas-xrd-eu.cern.ch\"",
+               "        \"eosrucio.upport 1094\"");
+    NoGo = 1;
   }
 
   return NoGo;
@@ -219,9 +240,12 @@ EosRucioOfs::stat(const char*             path,
 
   if (retc == SFS_REDIRECT)
   {
-    std::string err_data = out_error.getErrData();
+    // The redirect to an uplink is host:port alone while the one to EOS
+    // carries the pfn as opaque information
+    std::stringstream sstr;
+    sstr << out_error.getErrData() << ":" << out_error.getErrInfo();
 
-    if (err_data == mUplinkHost)
+    if (mUplinks.count(sstr.str()))
     {
       //........................................................................
       // If the file is not in EOS we redirect up to a meta manager and we
@@ -233,9 +257,9 @@ EosRucioOfs::stat(const char*             path,
     else
     {
       // We know that the file is in EOS and accessible since the EosRucioCms::
-      // Locate methos stat-ed the file. Therefore, here we just to a dummy
-      // stat to populate the stat buffer passed to this functon.
-      lstat("/etc/passwd", buf);
+      // Locate methos stat-ed the file and passed its metadata along with the
+      // redirection, so the stat buffer is filled without a new stat.
+      FillStat(out_error.getErrData(), buf);
       OfsEroute.Emsg("stat", "Found in EOS Rucio file: ", path);
       return SFS_OK;
     }
@@ -245,3 +269,55 @@ EosRucioOfs::stat(const char*             path,
 }
 
 
+//------------------------------------------------------------------------------
+// Fill the stat buffer with the metadata of the file in EOS
+//------------------------------------------------------------------------------
+void
+EosRucioOfs::FillStat(const char* redirect, struct stat* buf)
+{
+  memset(buf, 0, sizeof(struct stat));
+  buf->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+  buf->st_nlink = 1;
+  buf->st_blksize = 4096;
+  const char* opaque = strchr(redirect, '?');
+
+  // An older Cms plugin sends no metadata, the file is then reported as an
+  // empty readable file
+  if (!opaque)
+    return;
+
+  XrdOucEnv env(opaque + 1);
+  const char* val = env.Get("eosrucio.size");
+
+  if (!val)
+    return;
+
+  buf->st_size = strtoull(val, 0, 10);
+  buf->st_blocks = (buf->st_size + 511) / 512;
+
+  if ((val = env.Get("eosrucio.mtime")))
+    buf->st_mtime = buf->st_ctime = buf->st_atime = strtoull(val, 0, 10);
+
+  if ((val = env.Get("eosrucio.ino")))
+    buf->st_ino = strtoull(val, 0, 10);
+
+  if ((val = env.Get("eosrucio.flags")))
+  {
+    // Same mapping of the flags to the mode bits as the XRootD Posix layer
+    unsigned long flags = strtoul(val, 0, 10);
+    mode_t mode = ((flags & XrdCl::StatInfo::IsDir) ? S_IFDIR : S_IFREG);
+
+    if (flags & XrdCl::StatInfo::IsReadable)
+      mode |= S_IRUSR | S_IRGRP | S_IROTH;
+
+    if (flags & XrdCl::StatInfo::IsWritable)
+      mode |= S_IWUSR;
+
+    if (flags & XrdCl::StatInfo::XBitSet)
+      mode |= S_IXUSR | S_IXGRP | S_IXOTH;
+
+    buf->st_mode = mode;
+  }
+}
+
+
@@ -27,6 +27,7 @@
 /*----------------------------------------------------------------------------*/
 #include "XrdOfs/XrdOfs.hh"
 #include <string>
+#include <set>
 /*----------------------------------------------------------------------------*/
 
 //------------------------------------------------------------------------------
@@ -65,9 +66,19 @@ class EosRucioOfs: public XrdOfs
 
   private:
 
-    std::string mUplinkInstance; ///< Uplink instance host:port
+    //--------------------------------------------------------------------------
+    //! Fill the stat buffer with the metadata of the file in EOS passed by the
+    //! Cms plugin as opaque information of the redirection
+    //!
+    //! @param redirect host and opaque information of the redirection to EOS
+    //! @param buf stat buffer to fill
+    //!
+    //--------------------------------------------------------------------------
+    void FillStat(const char* redirect, struct stat* buf);
+
     std::string mUplinkHost; ///< uplink host address where failed req are redirected
     unsigned int mUplinkPort; ///< uplink host port where failed req are redirected
+    std::set<std::string> mUplinks; ///< host:port of every uplink, see upendpoint
 };
 
 
@@ -0,0 +1,127 @@
+// -----------------------------------------------------------------------------
+// File: LatencyStats.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+#include <algorithm>
+#include <time.h>
+/*----------------------------------------------------------------------------*/
+
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+LatencyStats::LatencyStats():
+  mPos(0),
+  mNumOk(0),
+  mNumErr(0)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Add latency sample
+//------------------------------------------------------------------------------
+void
+LatencyStats::AddLatency(uint64_t latency_us)
+{
+  XrdSysMutexHelper lock(mMutex);
+  mWindow[mPos] = latency_us;
+  mPos = (mPos + 1) % sWindowSize;
+  mNumOk++;
+}
+
+
+//------------------------------------------------------------------------------
+// Account for an operation which failed or timed out
+//------------------------------------------------------------------------------
+void
+LatencyStats::AddError()
+{
+  XrdSysMutexHelper lock(mMutex);
+  mNumErr++;
+}
+
+
+//------------------------------------------------------------------------------
+// Get percentile of the latency samples in the window
+//------------------------------------------------------------------------------
+uint64_t
+LatencyStats::GetPercentile(unsigned int percentile)
+{
+  uint64_t samples[sWindowSize];
+  size_t num;
+  {
+    XrdSysMutexHelper lock(mMutex);
+    num = ((mNumOk < sWindowSize) ? mNumOk : sWindowSize);
+    std::copy(mWindow, mWindow + num, samples);
+  }
+
+  if (!num)
+    return 0;
+
+  if (percentile > 100)
+    percentile = 100;
+
+  size_t index = (num * percentile + 99) / 100;
+  index = (index ? index - 1 : 0);
+  std::nth_element(samples, samples + index, samples + num);
+  return samples[index];
+}
+
+
+//------------------------------------------------------------------------------
+// Get number of samples currently in the window
+//------------------------------------------------------------------------------
+size_t
+LatencyStats::GetNumSamples()
+{
+  XrdSysMutexHelper lock(mMutex);
+  return ((mNumOk < sWindowSize) ? mNumOk : sWindowSize);
+}
+
+
+//------------------------------------------------------------------------------
+// Get total number of latency samples and errors recorded
+//------------------------------------------------------------------------------
+void
+LatencyStats::GetCounters(uint64_t& num_ok, uint64_t& num_err)
+{
+  XrdSysMutexHelper lock(mMutex);
+  num_ok = mNumOk;
+  num_err = mNumErr;
+}
+
+
+//------------------------------------------------------------------------------
+// Get current monotonic time in microseconds
+//------------------------------------------------------------------------------
+uint64_t
+LatencyStats::NowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
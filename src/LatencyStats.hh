@@ -0,0 +1,116 @@
+// -----------------------------------------------------------------------------
+// File: LatencyStats.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_LATENCYSTATS_HH__
+#define __EOS_LATENCYSTATS_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstddef>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class LatencyStats keeping a rolling window of the most recent latency
+//! samples of an operation together with its error count
+//------------------------------------------------------------------------------
+class LatencyStats
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Number of samples kept in the rolling window
+    //--------------------------------------------------------------------------
+    static const size_t sWindowSize = 128;
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    LatencyStats();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~LatencyStats() { };
+
+
+    //--------------------------------------------------------------------------
+    //! Add latency sample of an operation which got a reply
+    //!
+    //! @param latency_us latency in microseconds
+    //!
+    //--------------------------------------------------------------------------
+    void AddLatency(uint64_t latency_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Account for an operation which failed or timed out
+    //--------------------------------------------------------------------------
+    void AddError();
+
+
+    //--------------------------------------------------------------------------
+    //! Get percentile of the latency samples in the window
+    //!
+    //! @param percentile percentile value between 1 and 100
+    //!
+    //! @return latency in microseconds or 0 if there are no samples yet
+    //!
+    //--------------------------------------------------------------------------
+    uint64_t GetPercentile(unsigned int percentile);
+
+
+    //--------------------------------------------------------------------------
+    //! Get number of samples currently in the window
+    //--------------------------------------------------------------------------
+    size_t GetNumSamples();
+
+
+    //--------------------------------------------------------------------------
+    //! Get total number of latency samples and errors recorded
+    //!
+    //! @param num_ok number of operations which got a reply
+    //! @param num_err number of operations which failed
+    //!
+    //--------------------------------------------------------------------------
+    void GetCounters(uint64_t& num_ok, uint64_t& num_err);
+
+
+    //--------------------------------------------------------------------------
+    //! Get current monotonic time in microseconds
+    //--------------------------------------------------------------------------
+    static uint64_t NowUs();
+
+  private:
+
+    XrdSysMutex mMutex; ///< mutex protecting the members below
+    uint64_t mWindow[sWindowSize]; ///< ring buffer of latency samples
+    size_t mPos; ///< position of the next sample in the ring buffer
+    uint64_t mNumOk; ///< total number of latency samples
+    uint64_t mNumErr; ///< total number of errors
+};
+
+#endif //__EOS_LATENCYSTATS_HH__
@@ -0,0 +1,238 @@
+// -----------------------------------------------------------------------------
+// File: PfnCache.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "PfnCache.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstring>
+/*----------------------------------------------------------------------------*/
+
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+PfnCache::PfnCache(size_t max_bytes, uint64_t pos_ttl_us, uint64_t neg_ttl_us):
+  mNumGroups(max_bytes / (sNumShards * sGroupSize * (sizeof(Slot) + 1))),
+  mPosTtlUs(pos_ttl_us),
+  mNegTtlUs(neg_ttl_us)
+{
+  if (mNumGroups == 0)
+    mNumGroups = 1;
+
+  for (size_t i = 0; i < sNumShards; ++i)
+  {
+    Shard& shard = mShards[i];
+    shard.slots = new Slot[mNumGroups * sGroupSize];
+    shard.hands = new unsigned char[mNumGroups];
+    memset(shard.slots, 0, mNumGroups * sGroupSize * sizeof(Slot));
+    memset(shard.hands, 0, mNumGroups);
+    shard.hits = shard.neg_hits = shard.misses = 0;
+    shard.inserts = shard.evictions = shard.entries = 0;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+PfnCache::~PfnCache()
+{
+  for (size_t i = 0; i < sNumShards; ++i)
+  {
+    delete[] mShards[i].slots;
+    delete[] mShards[i].hands;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Get the first slot of the group holding a digest
+//------------------------------------------------------------------------------
+PfnCache::Slot*
+PfnCache::GetGroup(const unsigned char* digest, Shard*& shard, size_t& group)
+{
+  // The digest is uniformly distributed so its bytes are used directly
+  uint64_t hash;
+  memcpy(&hash, digest + sizeof(hash), sizeof(hash));
+  shard = &mShards[digest[0] & (sNumShards - 1)];
+  group = hash % mNumGroups;
+  return shard->slots + group * sGroupSize;
+}
+
+
+//------------------------------------------------------------------------------
+// Look up the outcome of a previous existence check
+//------------------------------------------------------------------------------
+bool
+PfnCache::Get(const unsigned char* digest, int& token)
+{
+  Shard* shard;
+  size_t group;
+  Slot* slots = GetGroup(digest, shard, group);
+  uint64_t now = LatencyStats::NowUs();
+  XrdSysMutexHelper scope_lock(shard->mutex);
+
+  for (size_t i = 0; i < sGroupSize; ++i)
+  {
+    Slot& slot = slots[i];
+
+    if (!slot.expire_us || memcmp(slot.digest, digest, MD5_DIGEST_LENGTH))
+      continue;
+
+    if (now >= slot.expire_us)
+    {
+      slot.expire_us = 0;
+      shard->entries--;
+      break;
+    }
+
+    slot.ref = 1;
+    token = slot.token;
+
+    if (token == sNotFound)
+      shard->neg_hits++;
+    else
+      shard->hits++;
+
+    return true;
+  }
+
+  shard->misses++;
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Drop the positive entry of a digest
+//------------------------------------------------------------------------------
+bool
+PfnCache::ErasePositive(const unsigned char* digest)
+{
+  Shard* shard;
+  size_t group;
+  Slot* slots = GetGroup(digest, shard, group);
+  XrdSysMutexHelper scope_lock(shard->mutex);
+
+  for (size_t i = 0; i < sGroupSize; ++i)
+  {
+    Slot& slot = slots[i];
+
+    if (!slot.expire_us || memcmp(slot.digest, digest, MD5_DIGEST_LENGTH))
+      continue;
+
+    if (slot.token == sNotFound)
+      return false;
+
+    slot.expire_us = 0;
+    shard->entries--;
+    return true;
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Store the outcome of an existence check
+//------------------------------------------------------------------------------
+void
+PfnCache::Put(const unsigned char* digest, int token)
+{
+  uint64_t ttl = (token == sNotFound ? mNegTtlUs : mPosTtlUs);
+
+  if (!ttl)
+    return;
+
+  Shard* shard;
+  size_t group;
+  Slot* slots = GetGroup(digest, shard, group);
+  uint64_t now = LatencyStats::NowUs();
+  Slot* victim = 0;
+  XrdSysMutexHelper scope_lock(shard->mutex);
+
+  // Look for the same digest or else for a free slot
+  for (size_t i = 0; i < sGroupSize; ++i)
+  {
+    Slot& slot = slots[i];
+
+    if (slot.expire_us && !memcmp(slot.digest, digest, MD5_DIGEST_LENGTH))
+    {
+      victim = &slot;
+      break;
+    }
+
+    if (!victim && (!slot.expire_us || (now >= slot.expire_us)))
+      victim = &slot;
+  }
+
+  if (!victim)
+  {
+    // Group full of valid entries, the CLOCK hand skips the recently used
+    // ones and clears their reference bit
+    unsigned char& hand = shard->hands[group];
+
+    while (slots[hand].ref)
+    {
+      slots[hand].ref = 0;
+      hand = (hand + 1) % sGroupSize;
+    }
+
+    victim = &slots[hand];
+    hand = (hand + 1) % sGroupSize;
+    shard->evictions++;
+  }
+  else if (!victim->expire_us)
+  {
+    shard->entries++;
+  }
+
+  memcpy(victim->digest, digest, MD5_DIGEST_LENGTH);
+  victim->expire_us = now + ttl;
+  victim->token = token;
+  victim->ref = 0;
+  shard->inserts++;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the cache counters summed over all the shards
+//------------------------------------------------------------------------------
+void
+PfnCache::GetStats(Stats& stats)
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.capacity = sNumShards * mNumGroups * sGroupSize;
+
+  for (size_t i = 0; i < sNumShards; ++i)
+  {
+    Shard& shard = mShards[i];
+    XrdSysMutexHelper scope_lock(shard.mutex);
+    stats.hits += shard.hits;
+    stats.neg_hits += shard.neg_hits;
+    stats.misses += shard.misses;
+    stats.inserts += shard.inserts;
+    stats.evictions += shard.evictions;
+    stats.entries += shard.entries;
+  }
+}
@@ -0,0 +1,190 @@
+// -----------------------------------------------------------------------------
+// File: PfnCache.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_PFNCACHE_HH__
+#define __EOS_PFNCACHE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstddef>
+#include <stdint.h>
+#include <openssl/md5.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class PfnCache remembering the outcome of the recent existence checks in
+//! EOS. An entry maps the MD5 digest of a Rucio "scope:name" key either to the
+//! index of the space token where the file was found (positive entry) or to
+//! the fact that the file is not in EOS (negative entry). Each kind of entry
+//! has its own time to live.
+//!
+//! The table is split into shards, each protected by its own mutex, and the
+//! digest selects both the shard and a group of sGroupSize slots inside it.
+//! Lookups and inserts only scan that group, and when the group is full the
+//! victim is picked by a CLOCK hand so that recently used entries survive.
+//! The total number of slots is fixed at construction from the memory limit.
+//------------------------------------------------------------------------------
+class PfnCache
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Token index stored in the negative entries
+    //--------------------------------------------------------------------------
+    static const int sNotFound = -1;
+
+
+    //--------------------------------------------------------------------------
+    //! Number of shards, must be a power of two
+    //--------------------------------------------------------------------------
+    static const size_t sNumShards = 64;
+
+
+    //--------------------------------------------------------------------------
+    //! Number of slots scanned for a digest
+    //--------------------------------------------------------------------------
+    static const size_t sGroupSize = 8;
+
+
+    //--------------------------------------------------------------------------
+    //! Cache counters
+    //--------------------------------------------------------------------------
+    struct Stats
+    {
+      uint64_t hits; ///< lookups which found a positive entry
+      uint64_t neg_hits; ///< lookups which found a negative entry
+      uint64_t misses; ///< lookups which found no valid entry
+      uint64_t inserts; ///< entries added or refreshed
+      uint64_t evictions; ///< valid entries dropped to make room
+      uint64_t entries; ///< valid or expired entries currently stored
+      uint64_t capacity; ///< total number of slots
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //!
+    //! @param max_bytes upper limit for the memory used by the table
+    //! @param pos_ttl_us time to live of a positive entry in microseconds
+    //! @param neg_ttl_us time to live of a negative entry in microseconds
+    //!
+    //--------------------------------------------------------------------------
+    PfnCache(size_t max_bytes, uint64_t pos_ttl_us, uint64_t neg_ttl_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~PfnCache();
+
+
+    //--------------------------------------------------------------------------
+    //! Look up the outcome of a previous existence check
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param token index of the space token holding the file or sNotFound
+    //!
+    //! @return true if a valid entry was found, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Get(const unsigned char* digest, int& token);
+
+
+    //--------------------------------------------------------------------------
+    //! Drop the entry of a digest if it says the file is in EOS
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //!
+    //! @return true if a positive entry was dropped, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool ErasePositive(const unsigned char* digest);
+
+
+    //--------------------------------------------------------------------------
+    //! Store the outcome of an existence check, replacing any previous entry
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param token index of the space token holding the file or sNotFound
+    //!
+    //--------------------------------------------------------------------------
+    void Put(const unsigned char* digest, int token);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the cache counters summed over all the shards
+    //!
+    //! @param stats structure filled with the counters
+    //!
+    //--------------------------------------------------------------------------
+    void GetStats(Stats& stats);
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Cache entry
+    //--------------------------------------------------------------------------
+    struct Slot
+    {
+      unsigned char digest[MD5_DIGEST_LENGTH]; ///< key of the entry
+      uint64_t expire_us; ///< expiry time, 0 marks an empty slot
+      int32_t token; ///< space token index or sNotFound
+      uint32_t ref; ///< CLOCK reference bit
+    };
+
+    //--------------------------------------------------------------------------
+    //! Shard of the table, padded so that the locks of different shards do
+    //! not share a cache line
+    //--------------------------------------------------------------------------
+    struct Shard
+    {
+      XrdSysMutex mutex; ///< mutex protecting the members below
+      Slot* slots; ///< slots of the shard, mNumGroups * sGroupSize
+      unsigned char* hands; ///< CLOCK hand of each group
+      uint64_t hits; ///< lookups which found a positive entry
+      uint64_t neg_hits; ///< lookups which found a negative entry
+      uint64_t misses; ///< lookups which found no valid entry
+      uint64_t inserts; ///< entries added or refreshed
+      uint64_t evictions; ///< valid entries dropped to make room
+      uint64_t entries; ///< occupied slots
+      char pad[64]; ///< keeps the next shard on another cache line
+    };
+
+    //--------------------------------------------------------------------------
+    //! Get the first slot of the group holding a digest
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param shard set to the shard holding the group
+    //! @param group set to the index of the group inside the shard
+    //!
+    //--------------------------------------------------------------------------
+    Slot* GetGroup(const unsigned char* digest, Shard*& shard, size_t& group);
+
+    Shard mShards[sNumShards]; ///< shards of the table
+    size_t mNumGroups; ///< number of slot groups per shard
+    uint64_t mPosTtlUs; ///< time to live of a positive entry
+    uint64_t mNegTtlUs; ///< time to live of a negative entry
+};
+
+#endif //__EOS_PFNCACHE_HH__
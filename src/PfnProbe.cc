@@ -0,0 +1,693 @@
+// -----------------------------------------------------------------------------
+// File: PfnProbe.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "PfnProbe.hh"
+/*----------------------------------------------------------------------------*/
+#include "XProtocol/XProtocol.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Handle the reply of one stat request
+//------------------------------------------------------------------------------
+void
+PfnProbe::StatHandler::HandleResponse(XrdCl::XRootDStatus* status,
+                                      XrdCl::AnyObject* response)
+{
+  mProbe->HandleReply(mIndex, status, response);
+  delete this;
+}
+
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+PfnProbe::PfnProbe(XrdCl::FileSystem* fs, Mode mode, uint16_t timeout,
+                   unsigned int hedge_pct):
+  mFs(fs),
+  mMode(mode),
+  mTimeout(timeout),
+  mHedgePct(hedge_pct),
+  mHedgeDeadline(0),
+  mDeadline(0),
+  mExpired(false),
+  mRefs(1),
+  mDone(false),
+  mWinner(-1),
+  mNumSent(0),
+  mNumHedged(0),
+  mNumReplied(0),
+  mNumFailed(0),
+  mListener(0),
+  mTimer(0),
+  mNotified(false)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+PfnProbe::~PfnProbe()
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Add candidate pfn to be checked
+//------------------------------------------------------------------------------
+void
+PfnProbe::AddCandidate(const std::string& pfn, LatencyStats* stats,
+                       Bulkhead* bulkhead)
+{
+  mCandidates.push_back(pfn);
+  mStats.push_back(stats);
+  mBulkheads.push_back(bulkhead);
+  mSentUs.push_back(0);
+  mExpireUs.push_back(0);
+  mState.push_back(eIdle);
+  mSize.push_back(0);
+  mMtime.push_back(0);
+  mFlags.push_back(0);
+}
+
+
+//------------------------------------------------------------------------------
+// Set a deadline for the whole probe
+//------------------------------------------------------------------------------
+void
+PfnProbe::SetDeadline(uint64_t budget_us)
+{
+  mDeadline = LatencyStats::NowUs() + budget_us;
+}
+
+
+//------------------------------------------------------------------------------
+// Send the stat requests according to the probing mode
+//------------------------------------------------------------------------------
+void
+PfnProbe::Start()
+{
+  if (mCandidates.empty())
+  {
+    mCond.Lock();
+    mDone = true;
+    mCond.UnLock();
+    return;
+  }
+
+  if (mMode == eParallel)
+  {
+    for (size_t index = 0; index < mCandidates.size(); ++index)
+      SendStat(index);
+  }
+  else
+  {
+    SendStat(0);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Send stat request for a candidate
+//------------------------------------------------------------------------------
+void
+PfnProbe::SendStat(size_t index, bool hedged)
+{
+  uint64_t hedge_delay = 0;
+  uint64_t timeout_us = static_cast<uint64_t>(mTimeout) * 1000000;
+  bool enough_samples = (mStats[index] &&
+                         (mStats[index]->GetNumSamples() >= sHedgeMinSamples));
+
+  // Next candidate is sent if this one does not reply within the usual time
+  if ((mMode == eHedged) && (index + 1 < mCandidates.size()))
+  {
+    hedge_delay = sHedgeDefaultUs;
+
+    if (enough_samples)
+      hedge_delay = mStats[index]->GetPercentile(mHedgePct);
+
+    // Timer granularity is one millisecond
+    if (hedge_delay < 1000)
+      hedge_delay = 1000;
+  }
+
+  // With a deadline, the timeout adapts to the latency of the space token
+  if (mDeadline && enough_samples)
+  {
+    uint64_t adaptive_us = sTimeoutFactor * mStats[index]->GetPercentile(99);
+
+    if (adaptive_us < sTimeoutFloorUs)
+      adaptive_us = sTimeoutFloorUs;
+
+    if (adaptive_us < timeout_us)
+      timeout_us = adaptive_us;
+  }
+
+  uint64_t now = LatencyStats::NowUs();
+  mCond.Lock();
+
+  if (mDone || (mState[index] != eIdle))
+  {
+    mCond.UnLock();
+    return;
+  }
+
+  if (mDeadline)
+  {
+    if (now >= mDeadline)
+    {
+      mCond.UnLock();
+      return;
+    }
+
+    if (timeout_us > mDeadline - now)
+      timeout_us = mDeadline - now;
+
+    mExpireUs[index] = now + timeout_us;
+  }
+
+  // A space token at its limit is skipped instead of queuing behind its
+  // outstanding stats, the outcome of the probe is then inconclusive
+  if (mBulkheads[index] && !mBulkheads[index]->TryAcquire())
+  {
+    size_t next = CandidateDone(index, false, true);
+    mCond.UnLock();
+
+    if (next < mCandidates.size())
+      SendStat(next);
+
+    return;
+  }
+
+  mState[index] = eInFlight;
+  mSentUs[index] = now;
+  mNumSent++;
+
+  if (hedged)
+    mNumHedged++;
+
+  if (mMode == eHedged)
+    mHedgeDeadline = (hedge_delay ? now + hedge_delay : 0);
+
+  // Wake up the waiting thread since the timers changed
+  mCond.Broadcast();
+  mRefs++;
+  uint64_t next_timer = (mTimer ? GetNextTimer() : 0);
+  mCond.UnLock();
+
+  if (next_timer)
+    mTimer->Schedule(this, next_timer);
+
+  // The XrdCl timeout has a granularity of one second and makes sure that the
+  // request is eventually answered even if the adaptive timeout expires first
+  uint16_t xrd_timeout = static_cast<uint16_t>((timeout_us + 999999) / 1000000);
+  // The lock is not held while sending since the reply can arrive right away
+  StatHandler* handler = new StatHandler(this, index);
+  XrdCl::XRootDStatus st = mFs->Stat(mCandidates[index], handler, xrd_timeout);
+
+  // If the request could not be sent the handler is never called
+  if (!st.IsOK())
+    handler->HandleResponse(new XrdCl::XRootDStatus(st), 0);
+}
+
+
+//------------------------------------------------------------------------------
+// Get index of the first candidate not sent yet
+//------------------------------------------------------------------------------
+size_t
+PfnProbe::GetNextIdle() const
+{
+  size_t index = 0;
+
+  while ((index < mState.size()) && (mState[index] != eIdle))
+    ++index;
+
+  return index;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the first candidate, in priority order, which found the file
+//------------------------------------------------------------------------------
+int
+PfnProbe::GetFirstHit(bool ordered) const
+{
+  for (size_t index = 0; index < mState.size(); ++index)
+  {
+    if (mState[index] == eHit)
+      return index;
+
+    if (ordered && (mState[index] != eMiss))
+      break;
+  }
+
+  return -1;
+}
+
+
+//------------------------------------------------------------------------------
+// Process the reply for a candidate
+//------------------------------------------------------------------------------
+void
+PfnProbe::HandleReply(size_t index, XrdCl::XRootDStatus* status,
+                      XrdCl::AnyObject* response)
+{
+  bool hit = false;
+  bool failed = true;
+  size_t next = mCandidates.size();
+  XrdCl::StatInfo* info = 0;
+
+  if (status && status->IsOK() && response)
+  {
+    response->Get(info);
+    hit = (info && info->TestFlags(XrdCl::StatInfo::IsReadable |
+                                   XrdCl::StatInfo::IsWritable));
+  }
+
+  // Only a stat reply or a file not found error is a clean answer measuring
+  // the latency of the space token. Any other error from the server (e.g. not
+  // authorized, overloaded or I/O error) says nothing about the file.
+  if (status && (status->IsOK() ||
+                 ((status->code == XrdCl::errErrorResponse) &&
+                  (status->errNo == kXR_NotFound))))
+    failed = false;
+
+  if (mBulkheads[index])
+    mBulkheads[index]->Release();
+
+  if (mStats[index])
+  {
+    if (!failed)
+      mStats[index]->AddLatency(LatencyStats::NowUs() - mSentUs[index]);
+    else
+      mStats[index]->AddError();
+  }
+
+  mCond.Lock();
+
+  // A reply arriving after the adaptive timeout of the candidate is ignored
+  if (mState[index] == eInFlight)
+  {
+    // The metadata of the file is kept for the stat of the Ofs plugin
+    if (hit)
+    {
+      mSize[index] = info->GetSize();
+      mMtime[index] = info->GetModTime();
+      mFlags[index] = info->GetFlags();
+    }
+
+    next = CandidateDone(index, hit, failed);
+  }
+
+  mCond.UnLock();
+  delete status;
+  delete response;
+
+  if (next < mCandidates.size())
+    SendStat(next);
+
+  Notify();
+  Unref();
+}
+
+
+//------------------------------------------------------------------------------
+// Record the outcome of a candidate and find the next one to send
+//------------------------------------------------------------------------------
+size_t
+PfnProbe::CandidateDone(size_t index, bool hit, bool failed)
+{
+  size_t next = mCandidates.size();
+  mState[index] = (hit ? eHit : eMiss);
+  mNumReplied++;
+
+  if (failed)
+    mNumFailed++;
+
+  if (!mDone)
+  {
+    if (mMode == eParallel)
+    {
+      // The replies arrive in any order, a hit wins only once the candidates
+      // of higher priority missed
+      mWinner = GetFirstHit(true);
+
+      if ((mWinner >= 0) || (mNumReplied == mCandidates.size()))
+      {
+        mDone = true;
+        mCond.Broadcast();
+      }
+    }
+    else if (hit)
+    {
+      mWinner = index;
+      mDone = true;
+      mCond.Broadcast();
+    }
+    else if (GetNextIdle() < mCandidates.size())
+    {
+      next = GetNextIdle();
+    }
+    else if (mNumReplied == mCandidates.size())
+    {
+      mDone = true;
+      mCond.Broadcast();
+    }
+  }
+
+  return next;
+}
+
+
+//------------------------------------------------------------------------------
+// Process the timers which expired
+//------------------------------------------------------------------------------
+size_t
+PfnProbe::ProcessTimers(uint64_t now, bool& hedged)
+{
+  size_t next = mCandidates.size();
+  hedged = false;
+
+  if (mDeadline && (now >= mDeadline))
+  {
+    // The best hit waiting for candidates of higher priority is taken
+    mWinner = GetFirstHit(false);
+    mExpired = true;
+    mDone = true;
+    mCond.Broadcast();
+    return next;
+  }
+
+  // Candidates whose adaptive timeout expired count as misses
+  for (size_t index = 0; index < mState.size(); ++index)
+  {
+    if ((mState[index] == eInFlight) && mExpireUs[index] &&
+        (now >= mExpireUs[index]))
+    {
+      mState[index] = eMiss;
+      mNumReplied++;
+      mNumFailed++;
+
+      if ((mMode != eParallel) && (GetNextIdle() < mCandidates.size()))
+        next = GetNextIdle();
+    }
+  }
+
+  if (mMode == eParallel)
+    mWinner = GetFirstHit(true);
+
+  if ((mWinner >= 0) || (mNumReplied == mCandidates.size()))
+  {
+    mDone = true;
+    mCond.Broadcast();
+    return mCandidates.size();
+  }
+
+  if ((next == mCandidates.size()) && mHedgeDeadline && (now >= mHedgeDeadline))
+  {
+    // The current candidate is slow, hedge with the next one
+    mHedgeDeadline = 0;
+    next = GetNextIdle();
+    hedged = true;
+  }
+
+  return next;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the time of the earliest pending timer
+//------------------------------------------------------------------------------
+uint64_t
+PfnProbe::GetNextTimer() const
+{
+  uint64_t next_timer = mDeadline;
+
+  if (mHedgeDeadline && (!next_timer || (mHedgeDeadline < next_timer)))
+    next_timer = mHedgeDeadline;
+
+  for (size_t index = 0; index < mState.size(); ++index)
+  {
+    if ((mState[index] == eInFlight) && mExpireUs[index] &&
+        (!next_timer || (mExpireUs[index] < next_timer)))
+      next_timer = mExpireUs[index];
+  }
+
+  return next_timer;
+}
+
+
+//------------------------------------------------------------------------------
+// Wait for the probe to complete
+//------------------------------------------------------------------------------
+void
+PfnProbe::Wait()
+{
+  bool hedged;
+  mCond.Lock();
+
+  while (!mDone)
+  {
+    uint64_t now = LatencyStats::NowUs();
+    size_t next = ProcessTimers(now, hedged);
+
+    if (mDone)
+      break;
+
+    if (next < mCandidates.size())
+    {
+      mCond.UnLock();
+      SendStat(next, hedged);
+      mCond.Lock();
+      continue;
+    }
+
+    uint64_t next_timer = GetNextTimer();
+
+    if (!next_timer)
+      mCond.Wait();
+    else if (next_timer > now)
+      mCond.WaitMS(static_cast<int>((next_timer - now + 999) / 1000));
+  }
+
+  mCond.UnLock();
+}
+
+
+//------------------------------------------------------------------------------
+// Send the stat requests without waiting for the probe to complete
+//------------------------------------------------------------------------------
+void
+PfnProbe::StartAsync(Listener* listener, ProbeTimer* timer)
+{
+  mListener = listener;
+  mTimer = timer;
+  // The listener can release the creator reference while this is running
+  AddRef();
+  Start();
+  mCond.Lock();
+  uint64_t next_timer = (mDone ? 0 : GetNextTimer());
+  mCond.UnLock();
+
+  if (next_timer)
+    mTimer->Schedule(this, next_timer);
+
+  Notify();
+  Unref();
+}
+
+
+//------------------------------------------------------------------------------
+// Process the expired timers of an asynchronous probe
+//------------------------------------------------------------------------------
+void
+PfnProbe::OnTimer()
+{
+  bool hedged = false;
+  size_t next = mCandidates.size();
+  uint64_t next_timer = 0;
+  mCond.Lock();
+
+  if (!mDone)
+  {
+    next = ProcessTimers(LatencyStats::NowUs(), hedged);
+
+    if (!mDone && (next == mCandidates.size()))
+      next_timer = GetNextTimer();
+  }
+
+  mCond.UnLock();
+
+  if (next < mCandidates.size())
+    SendStat(next, hedged);
+  else if (next_timer)
+    mTimer->Schedule(this, next_timer);
+
+  Notify();
+}
+
+
+//------------------------------------------------------------------------------
+// Notify the listener if the probe completed
+//------------------------------------------------------------------------------
+void
+PfnProbe::Notify()
+{
+  if (!mListener)
+    return;
+
+  mCond.Lock();
+  bool notify = (mDone && !mNotified);
+
+  if (notify)
+    mNotified = true;
+
+  mCond.UnLock();
+
+  if (notify)
+    mListener->ProbeDone(this);
+}
+
+
+//------------------------------------------------------------------------------
+// Get index of the candidate that was found in EOS
+//------------------------------------------------------------------------------
+int
+PfnProbe::GetWinner()
+{
+  mCond.Lock();
+  int winner = mWinner;
+  mCond.UnLock();
+  return winner;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the metadata returned by the stat of the winning candidate
+//------------------------------------------------------------------------------
+bool
+PfnProbe::GetWinnerStat(uint64_t& size, uint64_t& mtime, uint32_t& flags)
+{
+  mCond.Lock();
+  bool found = (mWinner >= 0);
+  size = (found ? mSize[mWinner] : 0);
+  mtime = (found ? mMtime[mWinner] : 0);
+  flags = (found ? mFlags[mWinner] : 0);
+  mCond.UnLock();
+  return found;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the number of stat requests sent
+//------------------------------------------------------------------------------
+size_t
+PfnProbe::GetNumSent(size_t& num_hedged)
+{
+  mCond.Lock();
+  size_t num_sent = mNumSent;
+  num_hedged = mNumHedged;
+  mCond.UnLock();
+  return num_sent;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the number of stat requests answered by EOS
+//------------------------------------------------------------------------------
+size_t
+PfnProbe::GetNumAnswered()
+{
+  mCond.Lock();
+  size_t num_answered = mNumReplied - mNumFailed;
+  mCond.UnLock();
+  return num_answered;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if the probe completed because its deadline passed
+//------------------------------------------------------------------------------
+bool
+PfnProbe::IsExpired()
+{
+  mCond.Lock();
+  bool expired = mExpired;
+  mCond.UnLock();
+  return expired;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if the outcome of the probe is reliable
+//------------------------------------------------------------------------------
+bool
+PfnProbe::IsConclusive()
+{
+  mCond.Lock();
+  bool conclusive = ((mWinner >= 0) ||
+                     (!mExpired && !mNumFailed &&
+                      (mNumReplied == mCandidates.size())));
+  mCond.UnLock();
+  return conclusive;
+}
+
+
+//------------------------------------------------------------------------------
+// Take an extra reference to the object
+//------------------------------------------------------------------------------
+void
+PfnProbe::AddRef()
+{
+  mCond.Lock();
+  mRefs++;
+  mCond.UnLock();
+}
+
+
+//------------------------------------------------------------------------------
+// Release a reference to the object
+//------------------------------------------------------------------------------
+void
+PfnProbe::Release()
+{
+  Unref();
+}
+
+
+//------------------------------------------------------------------------------
+// Drop one reference and delete the object if it was the last one
+//------------------------------------------------------------------------------
+void
+PfnProbe::Unref()
+{
+  mCond.Lock();
+  bool last = (--mRefs == 0);
+  mCond.UnLock();
+
+  if (last)
+    delete this;
+}
@@ -0,0 +1,426 @@
+// -----------------------------------------------------------------------------
+// File: PfnProbe.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_PFNPROBE_HH__
+#define __EOS_PFNPROBE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdCl/XrdClFileSystem.hh"
+#include "XrdSys/XrdSysPthread.hh"
+#include "LatencyStats.hh"
+#include "Bulkhead.hh"
+#include "ProbeTimer.hh"
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class PfnProbe checking asynchronously the existence of a translated pfn
+//! in EOS under a list of candidate space tokens. The candidates are added in
+//! priority order and the first readable reply wins. The object is reference
+//! counted since the replies to the stats which were not needed anymore can
+//! arrive after the owner is done with it.
+//------------------------------------------------------------------------------
+class PfnProbe
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Probing modes
+    //--------------------------------------------------------------------------
+    enum Mode
+    {
+      eSequential = 0, ///< stat one candidate at a time in priority order
+      eParallel = 1, ///< stat all the candidates at once, the first hit in
+                     ///< priority order wins
+      eHedged = 2 ///< stat the next candidate if the current one is slow
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Interface notified when an asynchronous probe completes
+    //--------------------------------------------------------------------------
+    class Listener
+    {
+      public:
+
+        virtual ~Listener() { }
+
+        //----------------------------------------------------------------------
+        //! Called once, without any lock held, when the result is known
+        //!
+        //! @param probe completed probe
+        //!
+        //----------------------------------------------------------------------
+        virtual void ProbeDone(PfnProbe* probe) = 0;
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Hedge delay used for a candidate without enough latency samples
+    //--------------------------------------------------------------------------
+    static const uint64_t sHedgeDefaultUs = 100000;
+
+
+    //--------------------------------------------------------------------------
+    //! Minimum number of latency samples needed to use the percentile as the
+    //! hedge delay of a candidate
+    //--------------------------------------------------------------------------
+    static const size_t sHedgeMinSamples = 16;
+
+
+    //--------------------------------------------------------------------------
+    //! With a deadline, the stat timeout of a candidate is this multiple of the
+    //! p99 latency of its space token but never less than sTimeoutFloorUs
+    //--------------------------------------------------------------------------
+    static const uint64_t sTimeoutFactor = 4;
+    static const uint64_t sTimeoutFloorUs = 50000;
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //!
+    //! @param fs file system object of the EOS instance, shared and owned by
+    //!        the caller which must keep it alive as long as requests can be
+    //!        in flight
+    //! @param mode probing mode
+    //! @param timeout timeout in seconds for each stat request
+    //! @param hedge_pct latency percentile of a candidate after which the next
+    //!        one is sent in hedged mode
+    //!
+    //--------------------------------------------------------------------------
+    PfnProbe(XrdCl::FileSystem* fs, Mode mode, uint16_t timeout,
+             unsigned int hedge_pct = 95);
+
+
+    //--------------------------------------------------------------------------
+    //! Add candidate pfn to be checked - must be called in priority order and
+    //! before Start
+    //!
+    //! @param pfn full pfn name
+    //! @param stats latency statistics of the space token of the candidate,
+    //!        they are updated with the outcome of the stat request. Can be 0.
+    //! @param bulkhead limit of the outstanding stats of the space token, the
+    //!        candidate is skipped if the token is at its limit. Can be 0.
+    //!
+    //--------------------------------------------------------------------------
+    void AddCandidate(const std::string& pfn, LatencyStats* stats,
+                      Bulkhead* bulkhead = 0);
+
+
+    //--------------------------------------------------------------------------
+    //! Set a deadline for the whole probe - must be called before Start. When
+    //! set, a candidate which does not reply within its own adaptive timeout,
+    //! derived from the latency of its space token and bounded by the time
+    //! left, is considered a miss. When the deadline passes the probe
+    //! completes without a winner.
+    //!
+    //! @param budget_us time budget in microseconds starting from now
+    //!
+    //--------------------------------------------------------------------------
+    void SetDeadline(uint64_t budget_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Send the stat requests according to the probing mode
+    //--------------------------------------------------------------------------
+    void Start();
+
+
+    //--------------------------------------------------------------------------
+    //! Wait for the probe to complete. In hedged mode the waiting thread also
+    //! sends the next candidate when the current one does not reply in time.
+    //--------------------------------------------------------------------------
+    void Wait();
+
+
+    //--------------------------------------------------------------------------
+    //! Send the stat requests without waiting for the probe to complete. The
+    //! replies are processed in the XrdCl threads, the timers in the timer
+    //! thread, and the listener is notified from one of them or from this call
+    //! if the result is known right away. Wait must not be used.
+    //!
+    //! @param listener object notified when the probe completes
+    //! @param timer timer thread handling the timers of the probe
+    //!
+    //--------------------------------------------------------------------------
+    void StartAsync(Listener* listener, ProbeTimer* timer);
+
+
+    //--------------------------------------------------------------------------
+    //! Process the expired timers of an asynchronous probe - called by the
+    //! timer thread
+    //--------------------------------------------------------------------------
+    void OnTimer();
+
+
+    //--------------------------------------------------------------------------
+    //! Get index of the candidate that was found in EOS
+    //!
+    //! @return index of the winning candidate or -1 if none was found
+    //!
+    //--------------------------------------------------------------------------
+    int GetWinner();
+
+
+    //--------------------------------------------------------------------------
+    //! Get the metadata returned by the stat of the winning candidate
+    //!
+    //! @param size size of the file
+    //! @param mtime modification time of the file
+    //! @param flags XrdCl::StatInfo flags of the file
+    //!
+    //! @return true if a candidate was found, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool GetWinnerStat(uint64_t& size, uint64_t& mtime, uint32_t& flags);
+
+
+    //--------------------------------------------------------------------------
+    //! Get candidate pfn
+    //!
+    //! @param index index of the candidate
+    //!
+    //! @return full pfn name
+    //!
+    //--------------------------------------------------------------------------
+    const std::string& GetPfn(size_t index) const
+    {
+      return mCandidates[index];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of stat requests sent
+    //!
+    //! @param num_hedged number of requests sent because the previous
+    //!        candidate was too slow to reply
+    //!
+    //! @return total number of stat requests sent
+    //!
+    //--------------------------------------------------------------------------
+    size_t GetNumSent(size_t& num_hedged);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of stat requests answered by EOS before the probe
+    //! completed, i.e. the replies which were not errors or timeouts
+    //--------------------------------------------------------------------------
+    size_t GetNumAnswered();
+
+
+    //--------------------------------------------------------------------------
+    //! Check if the probe completed because its deadline passed
+    //--------------------------------------------------------------------------
+    bool IsExpired();
+
+
+    //--------------------------------------------------------------------------
+    //! Check if the outcome of the probe is reliable i.e. either a candidate
+    //! was found or all of them got a reply from the server before the
+    //! deadline. A probe without a winner due to errors or timeouts is not.
+    //--------------------------------------------------------------------------
+    bool IsConclusive();
+
+
+    //--------------------------------------------------------------------------
+    //! Take an extra reference to the object
+    //--------------------------------------------------------------------------
+    void AddRef();
+
+
+    //--------------------------------------------------------------------------
+    //! Release the reference held by the creator of the object or one taken
+    //! with AddRef. The object must not be used by the caller afterwards.
+    //--------------------------------------------------------------------------
+    void Release();
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! State of a candidate
+    //--------------------------------------------------------------------------
+    enum State
+    {
+      eIdle = 0, ///< stat not sent yet
+      eInFlight = 1, ///< stat sent, waiting for the reply
+      eMiss = 2, ///< file not found, error or adaptive timeout expired
+      eHit = 3 ///< file found and readable
+    };
+
+    //--------------------------------------------------------------------------
+    //! Handler for the reply of one stat request
+    //--------------------------------------------------------------------------
+    class StatHandler: public XrdCl::ResponseHandler
+    {
+      public:
+
+        StatHandler(PfnProbe* probe, size_t index):
+          mProbe(probe),
+          mIndex(index)
+        { }
+
+        virtual ~StatHandler() { }
+
+        virtual void HandleResponse(XrdCl::XRootDStatus* status,
+                                    XrdCl::AnyObject* response);
+
+      private:
+
+        PfnProbe* mProbe; ///< probe waiting for this reply
+        size_t mIndex; ///< index of the candidate
+    };
+
+    //--------------------------------------------------------------------------
+    //! Destructor - use Release
+    //--------------------------------------------------------------------------
+    ~PfnProbe();
+
+
+    //--------------------------------------------------------------------------
+    //! Send stat request for a candidate
+    //!
+    //! @param index index of the candidate
+    //! @param hedged true if sent because the previous candidate is slow
+    //!
+    //--------------------------------------------------------------------------
+    void SendStat(size_t index, bool hedged = false);
+
+
+    //--------------------------------------------------------------------------
+    //! Get index of the first candidate not sent yet - must be called with
+    //! the lock held
+    //!
+    //! @return index of the candidate or the number of candidates if all of
+    //!         them were already sent
+    //!
+    //--------------------------------------------------------------------------
+    size_t GetNextIdle() const;
+
+
+    //--------------------------------------------------------------------------
+    //! Get the first candidate, in priority order, which found the file -
+    //! must be called with the lock held
+    //!
+    //! @param ordered if true, a hit is only returned if every candidate
+    //!        before it missed
+    //!
+    //! @return index of the candidate or -1 if none
+    //!
+    //--------------------------------------------------------------------------
+    int GetFirstHit(bool ordered) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Process the timers which expired - must be called with the lock held
+    //!
+    //! @param now current time in microseconds
+    //! @param hedged set to true if the returned candidate is a hedged request
+    //!
+    //! @return index of the candidate to be sent or the number of candidates
+    //!         if none needs to be sent
+    //!
+    //--------------------------------------------------------------------------
+    size_t ProcessTimers(uint64_t now, bool& hedged);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the time of the earliest pending timer - must be called with the
+    //! lock held
+    //!
+    //! @return time in microseconds or 0 if there is no timer pending
+    //!
+    //--------------------------------------------------------------------------
+    uint64_t GetNextTimer() const;
+
+
+    //--------------------------------------------------------------------------
+    //! Record the outcome of a candidate and find the next one to send - must
+    //! be called with the lock held
+    //!
+    //! @param index candidate index
+    //! @param hit true if the file was found
+    //! @param failed true if the outcome is unknown
+    //!
+    //! @return index of the next candidate to send or the number of
+    //!         candidates if none
+    //!
+    //--------------------------------------------------------------------------
+    size_t CandidateDone(size_t index, bool hit, bool failed);
+
+
+    //--------------------------------------------------------------------------
+    //! Process the reply for a candidate
+    //!
+    //! @param index index of the candidate
+    //! @param status status of the request
+    //! @param response response object
+    //!
+    //--------------------------------------------------------------------------
+    void HandleReply(size_t index, XrdCl::XRootDStatus* status,
+                     XrdCl::AnyObject* response);
+
+
+    //--------------------------------------------------------------------------
+    //! Drop one reference and delete the object if it was the last one
+    //--------------------------------------------------------------------------
+    void Unref();
+
+
+    //--------------------------------------------------------------------------
+    //! Notify the listener if the probe completed and it was not notified yet
+    //! - must be called without the lock held
+    //--------------------------------------------------------------------------
+    void Notify();
+
+    XrdSysCondVar mCond; ///< cond. variable protecting the members below
+    XrdCl::FileSystem* mFs; ///< shared file system object, not owned
+    Mode mMode; ///< probing mode
+    uint16_t mTimeout; ///< timeout in seconds for a stat request
+    unsigned int mHedgePct; ///< latency percentile used as hedge delay
+    uint64_t mHedgeDeadline; ///< time in us when the next candidate is sent
+    uint64_t mDeadline; ///< time in us when the whole probe expires, 0 if none
+    bool mExpired; ///< true if the probe completed due to the deadline
+    int mRefs; ///< number of references to the object
+    bool mDone; ///< true when the result is known
+    int mWinner; ///< index of the winning candidate, -1 if none
+    size_t mNumSent; ///< number of stat requests sent
+    size_t mNumHedged; ///< number of stat requests sent by the hedge timer
+    size_t mNumReplied; ///< number of replies received
+    size_t mNumFailed; ///< number of candidates which failed or timed out
+    std::vector<std::string> mCandidates; ///< candidate pfns in priority order
+    std::vector<LatencyStats*> mStats; ///< latency stats of each candidate
+    std::vector<Bulkhead*> mBulkheads; ///< bulkhead of each candidate
+    std::vector<uint64_t> mSentUs; ///< time in us when each stat was sent
+    std::vector<uint64_t> mExpireUs; ///< time in us when each stat expires
+    std::vector<int> mState; ///< state of each candidate
+    std::vector<uint64_t> mSize; ///< file size returned by each hit
+    std::vector<uint64_t> mMtime; ///< modification time returned by each hit
+    std::vector<uint32_t> mFlags; ///< stat flags returned by each hit
+    Listener* mListener; ///< listener of an asynchronous probe
+    ProbeTimer* mTimer; ///< timer thread of an asynchronous probe
+    bool mNotified; ///< true once the listener was notified
+};
+
+#endif //__EOS_PFNPROBE_HH__
@@ -0,0 +1,156 @@
+// -----------------------------------------------------------------------------
+// File: ProbeTimer.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "ProbeTimer.hh"
+#include "PfnProbe.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+ProbeTimer::ProbeTimer():
+  mStop(false),
+  mRunning(false)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+ProbeTimer::~ProbeTimer()
+{
+  Stop();
+}
+
+
+//------------------------------------------------------------------------------
+// Start the timer thread
+//------------------------------------------------------------------------------
+bool
+ProbeTimer::Start()
+{
+  if (XrdSysThread::Run(&mTid, ProbeTimer::StartTimer, static_cast<void*>(this),
+                        XRDSYSTHREAD_HOLD, "EosRucioCms probe timer"))
+    return false;
+
+  mRunning = true;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Stop the timer thread and drop the scheduled probes
+//------------------------------------------------------------------------------
+void
+ProbeTimer::Stop()
+{
+  if (mRunning)
+  {
+    mCond.Lock();
+    mStop = true;
+    mCond.Signal();
+    mCond.UnLock();
+    XrdSysThread::Join(mTid, 0);
+    mRunning = false;
+  }
+
+  mCond.Lock();
+  std::multimap<uint64_t, PfnProbe*> timers;
+  timers.swap(mTimers);
+  mCond.UnLock();
+
+  for (auto it = timers.begin(); it != timers.end(); ++it)
+    it->second->Release();
+}
+
+
+//------------------------------------------------------------------------------
+// Schedule a call to the OnTimer method of a probe
+//------------------------------------------------------------------------------
+void
+ProbeTimer::Schedule(PfnProbe* probe, uint64_t when_us)
+{
+  probe->AddRef();
+  mCond.Lock();
+  auto it = mTimers.insert(std::make_pair(when_us, probe));
+
+  // Wake up the thread only if the earliest call changed
+  if (it == mTimers.begin())
+    mCond.Signal();
+
+  mCond.UnLock();
+}
+
+
+//------------------------------------------------------------------------------
+// Timer thread startup function
+//------------------------------------------------------------------------------
+void*
+ProbeTimer::StartTimer(void* arg)
+{
+  ProbeTimer* timer = static_cast<ProbeTimer*>(arg);
+  timer->Run();
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Timer thread loop
+//------------------------------------------------------------------------------
+void
+ProbeTimer::Run()
+{
+  mCond.Lock();
+
+  while (!mStop)
+  {
+    if (mTimers.empty())
+    {
+      mCond.Wait();
+      continue;
+    }
+
+    uint64_t now = LatencyStats::NowUs();
+    auto it = mTimers.begin();
+
+    if (it->first > now)
+    {
+      mCond.WaitMS(static_cast<int>((it->first - now + 999) / 1000));
+      continue;
+    }
+
+    // The probe is called without the lock since it can schedule itself again
+    PfnProbe* probe = it->second;
+    mTimers.erase(it);
+    mCond.UnLock();
+    probe->OnTimer();
+    probe->Release();
+    mCond.Lock();
+  }
+
+  mCond.UnLock();
+}
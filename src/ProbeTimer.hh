@@ -0,0 +1,102 @@
+// -----------------------------------------------------------------------------
+// File: ProbeTimer.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_PROBETIMER_HH__
+#define __EOS_PROBETIMER_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <map>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+class PfnProbe;
+
+//------------------------------------------------------------------------------
+//! Class ProbeTimer driving the timers of the asynchronous probes i.e. the
+//! hedge delays, the adaptive stat timeouts and the deadlines, which in the
+//! synchronous mode are handled by the thread waiting for the probe. One
+//! thread serves all the probes and holds a reference to each scheduled one.
+//------------------------------------------------------------------------------
+class ProbeTimer
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    ProbeTimer();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~ProbeTimer();
+
+
+    //--------------------------------------------------------------------------
+    //! Start the timer thread
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Start();
+
+
+    //--------------------------------------------------------------------------
+    //! Stop the timer thread and drop the scheduled probes
+    //--------------------------------------------------------------------------
+    void Stop();
+
+
+    //--------------------------------------------------------------------------
+    //! Schedule a call to the OnTimer method of a probe
+    //!
+    //! @param probe probe, a reference to it is held until the call
+    //! @param when_us monotonic time in microseconds of the call
+    //!
+    //--------------------------------------------------------------------------
+    void Schedule(PfnProbe* probe, uint64_t when_us);
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Timer thread startup function
+    //--------------------------------------------------------------------------
+    static void* StartTimer(void* arg);
+
+
+    //--------------------------------------------------------------------------
+    //! Timer thread loop
+    //--------------------------------------------------------------------------
+    void Run();
+
+    XrdSysCondVar mCond; ///< cond. variable protecting the members below
+    std::multimap<uint64_t, PfnProbe*> mTimers; ///< probes by time of the call
+    bool mStop; ///< flag to stop the timer thread
+    bool mRunning; ///< true if the timer thread is running
+    pthread_t mTid; ///< timer thread id
+};
+
+#endif //__EOS_PROBETIMER_HH__
@@ -0,0 +1,317 @@
+// -----------------------------------------------------------------------------
+// File: QosTable.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "QosTable.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstring>
+/*----------------------------------------------------------------------------*/
+#include "XrdSec/XrdSecEntity.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+QosTable::QosTable()
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+QosTable::~QosTable()
+{
+  for (auto it = mClasses.begin(); it != mClasses.end(); ++it)
+  {
+    delete[] (*it)->client_tat;
+    delete *it;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Add class
+//------------------------------------------------------------------------------
+void
+QosTable::AddClass(const std::string& name, const std::vector<Match>& matches,
+                   const Limits& limits)
+{
+  Class* cls = new Class();
+  cls->name = name;
+  cls->matches = matches;
+  cls->limits = limits;
+  cls->interval_us = 0;
+  cls->tolerance_us = 0;
+  cls->client_interval_us = 0;
+  cls->client_tolerance_us = 0;
+  cls->max_in_flight = 0;
+  cls->tat = 0;
+  cls->client_tat = 0;
+  cls->in_flight = 0;
+  cls->num_requests = 0;
+  cls->num_rate_limited = 0;
+  cls->num_client_limited = 0;
+  cls->num_share_limited = 0;
+
+  // Without an explicit burst a bucket holds one second worth of requests
+  if (limits.rate > 0)
+  {
+    double burst = (limits.burst >= 1 ? limits.burst :
+                    (limits.rate > 1 ? limits.rate : 1));
+    cls->interval_us = static_cast<uint64_t>(1e6 / limits.rate);
+    cls->tolerance_us = static_cast<uint64_t>((burst - 1) * 1e6 / limits.rate);
+  }
+
+  if (limits.client_rate > 0)
+  {
+    double burst = (limits.client_burst >= 1 ? limits.client_burst :
+                    (limits.client_rate > 1 ? limits.client_rate : 1));
+    cls->client_interval_us = static_cast<uint64_t>(1e6 / limits.client_rate);
+    cls->client_tolerance_us = static_cast<uint64_t>((burst - 1) * 1e6 /
+                               limits.client_rate);
+    cls->client_tat = new std::atomic<uint64_t>[sNumClientBuckets];
+
+    for (size_t i = 0; i < sNumClientBuckets; ++i)
+      cls->client_tat[i] = 0;
+  }
+
+  mClasses.push_back(cls);
+}
+
+
+//------------------------------------------------------------------------------
+// Add the default class and derive the concurrency limits
+//------------------------------------------------------------------------------
+void
+QosTable::Init(unsigned int max_in_flight)
+{
+  if (mClasses.empty())
+    return;
+
+  bool catch_all = false;
+
+  for (auto it = mClasses.begin(); it != mClasses.end(); ++it)
+  {
+    if ((*it)->matches.empty())
+      catch_all = true;
+  }
+
+  if (!catch_all)
+    AddClass("default", std::vector<Match>(), Limits());
+
+  for (auto it = mClasses.begin(); it != mClasses.end(); ++it)
+  {
+    Class* cls = *it;
+
+    if (max_in_flight && (cls->limits.share < 100))
+    {
+      cls->max_in_flight = max_in_flight * cls->limits.share / 100;
+
+      if (!cls->max_in_flight)
+        cls->max_in_flight = 1;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Find the class of a client
+//------------------------------------------------------------------------------
+int
+QosTable::Classify(const XrdSecEntity* entity) const
+{
+  for (size_t i = 0; i < mClasses.size(); ++i)
+  {
+    const std::vector<Match>& matches = mClasses[i]->matches;
+    bool match = true;
+
+    for (auto it = matches.begin(); match && (it != matches.end()); ++it)
+    {
+      const char* value = 0;
+
+      if (entity)
+      {
+        switch (it->field)
+        {
+        case eName:
+          value = entity->name;
+          break;
+
+        case eHost:
+          value = entity->host;
+          break;
+
+        case eVorg:
+          value = entity->vorg;
+          break;
+
+        case eRole:
+          value = entity->role;
+          break;
+
+        case eTident:
+          value = entity->tident;
+          break;
+        }
+      }
+
+      if (!value)
+        match = false;
+      else if (it->prefix)
+        match = !strncmp(value, it->pattern.c_str(), it->pattern.length());
+      else
+        match = (it->pattern == value);
+    }
+
+    if (match)
+      return static_cast<int>(i);
+  }
+
+  return -1;
+}
+
+
+//------------------------------------------------------------------------------
+// Hash the identity of a client
+//------------------------------------------------------------------------------
+uint32_t
+QosTable::HashClient(const XrdSecEntity* entity)
+{
+  uint32_t hash = 2166136261U;
+
+  if (!entity)
+    return hash;
+
+  const char* id = ((entity->name && *entity->name) ? entity->name :
+                    entity->tident);
+
+  if (!id)
+    return hash;
+
+  // A trace identifier looks like user.pid:fd@host, the pid and the file
+  // descriptor change with every connection of the client
+  const char* skip = 0;
+  const char* host = 0;
+
+  if (id == entity->tident)
+  {
+    host = strchr(id, '@');
+    skip = strchr(id, '.');
+
+    if (!host || (skip && (skip > host)))
+      skip = 0;
+  }
+
+  for (const char* p = id; *p; ++p)
+  {
+    if (skip && (p == skip))
+    {
+      p = host;
+      skip = 0;
+    }
+
+    hash ^= static_cast<unsigned char>(*p);
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+//------------------------------------------------------------------------------
+// Request the admission of an existence check
+//------------------------------------------------------------------------------
+QosTable::Verdict
+QosTable::Admit(int cls_index, uint32_t client)
+{
+  Class* cls = mClasses[cls_index];
+  cls->num_requests++;
+
+  if (cls->max_in_flight && (++cls->in_flight > cls->max_in_flight))
+  {
+    cls->in_flight--;
+    cls->num_share_limited++;
+    return eShareLimited;
+  }
+
+  uint64_t now = LatencyStats::NowUs();
+  Verdict verdict = eAllowed;
+
+  if (cls->client_tat &&
+      !Take(cls->client_tat[client % sNumClientBuckets], now,
+            cls->client_interval_us, cls->client_tolerance_us))
+  {
+    cls->num_client_limited++;
+    verdict = eClientLimited;
+  }
+  else if (cls->interval_us &&
+           !Take(cls->tat, now, cls->interval_us, cls->tolerance_us))
+  {
+    cls->num_rate_limited++;
+    verdict = eRateLimited;
+  }
+
+  if ((verdict != eAllowed) && cls->max_in_flight)
+    cls->in_flight--;
+
+  return verdict;
+}
+
+
+//------------------------------------------------------------------------------
+// Release an existence check admitted in a class
+//------------------------------------------------------------------------------
+void
+QosTable::Release(int cls_index)
+{
+  Class* cls = mClasses[cls_index];
+
+  if (cls->max_in_flight)
+    cls->in_flight--;
+}
+
+
+//------------------------------------------------------------------------------
+// Take a token from a bucket
+//------------------------------------------------------------------------------
+bool
+QosTable::Take(std::atomic<uint64_t>& tat, uint64_t now_us,
+               uint64_t interval_us, uint64_t tolerance_us)
+{
+  uint64_t old_tat = tat.load(std::memory_order_relaxed);
+
+  while (true)
+  {
+    uint64_t start = (old_tat > now_us ? old_tat : now_us);
+
+    if (start - now_us > tolerance_us)
+      return false;
+
+    if (tat.compare_exchange_weak(old_tat, start + interval_us,
+                                  std::memory_order_relaxed))
+      return true;
+  }
+}
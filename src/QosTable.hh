@@ -0,0 +1,250 @@
+// -----------------------------------------------------------------------------
+// File: QosTable.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_QOSTABLE_HH__
+#define __EOS_QOSTABLE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+class XrdSecEntity;
+
+//------------------------------------------------------------------------------
+//! Class QosTable classifying the locate requests by the identity of the
+//! client into QoS classes. Each class has a token bucket limiting the rate
+//! of its existence checks, a token bucket per client and a share of the
+//! existence checks which can be in flight to EOS. The buckets follow the
+//! generic cell rate algorithm: the state of a bucket is the theoretical
+//! arrival time of the next request, updated with a compare and swap. The
+//! classes are added during the configuration and fixed afterwards.
+//------------------------------------------------------------------------------
+class QosTable
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Field of the client identity matched by a class
+    //--------------------------------------------------------------------------
+    enum Field
+    {
+      eName, ///< user name
+      eHost, ///< client host
+      eVorg, ///< virtual organisation
+      eRole, ///< role in the virtual organisation
+      eTident ///< trace identifier
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Condition on a field of the client identity, the pattern matches
+    //! exactly or as a prefix if it ends with '*'
+    //--------------------------------------------------------------------------
+    struct Match
+    {
+      Field field; ///< field of the identity
+      std::string pattern; ///< value or prefix without the '*'
+      bool prefix; ///< true if the pattern is a prefix
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Limits of a class
+    //--------------------------------------------------------------------------
+    struct Limits
+    {
+      Limits(): rate(0), burst(0), client_rate(0), client_burst(0), share(100)
+      { }
+
+      double rate; ///< existence checks per second, 0 if unlimited
+      double burst; ///< checks allowed above the rate at once
+      double client_rate; ///< checks per second of one client, 0 if unlimited
+      double client_burst; ///< checks of one client allowed at once
+      unsigned int share; ///< percentage of the checks in flight
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Outcome of an admission request
+    //--------------------------------------------------------------------------
+    enum Verdict
+    {
+      eAllowed, ///< the check can go on
+      eRateLimited, ///< the class exceeds its rate
+      eClientLimited, ///< the client exceeds its rate
+      eShareLimited ///< the class has its share of checks in flight
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! QoS class
+    //--------------------------------------------------------------------------
+    struct Class
+    {
+      std::string name; ///< name of the class
+      std::vector<Match> matches; ///< conditions, all must hold
+      Limits limits; ///< configured limits
+      uint64_t interval_us; ///< time between two checks at the class rate
+      uint64_t tolerance_us; ///< burst expressed in time
+      uint64_t client_interval_us; ///< ... at the client rate
+      uint64_t client_tolerance_us; ///< client burst expressed in time
+      unsigned int max_in_flight; ///< checks in flight allowed, 0 if unlimited
+      std::atomic<uint64_t> tat; ///< theoretical arrival time of the class
+      std::atomic<uint64_t>* client_tat; ///< ... of the client buckets
+      std::atomic<unsigned int> in_flight; ///< checks in flight
+      std::atomic<uint64_t> num_requests; ///< checks requested
+      std::atomic<uint64_t> num_rate_limited; ///< checks over the class rate
+      std::atomic<uint64_t> num_client_limited; ///< checks over a client rate
+      std::atomic<uint64_t> num_share_limited; ///< checks over the share
+    };
+
+    //! Number of client buckets of a class, clients sharing a bucket are
+    //! limited together
+    static const size_t sNumClientBuckets = 1024;
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    QosTable();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~QosTable();
+
+
+    //--------------------------------------------------------------------------
+    //! Add class - the classes are matched in the order they are added
+    //!
+    //! @param name name of the class
+    //! @param matches conditions on the client identity, none matches every
+    //!        client
+    //! @param limits limits of the class
+    //!
+    //--------------------------------------------------------------------------
+    void AddClass(const std::string& name, const std::vector<Match>& matches,
+                  const Limits& limits);
+
+
+    //--------------------------------------------------------------------------
+    //! Add the default class matching every client if none does and derive
+    //! the concurrency limit of each class from its share
+    //!
+    //! @param max_in_flight maximum number of checks in flight, 0 if
+    //!        unlimited
+    //!
+    //--------------------------------------------------------------------------
+    void Init(unsigned int max_in_flight);
+
+
+    //--------------------------------------------------------------------------
+    //! Find the class of a client
+    //!
+    //! @param entity identity of the client, can be 0
+    //!
+    //! @return class index or -1 if there are no classes
+    //!
+    //--------------------------------------------------------------------------
+    int Classify(const XrdSecEntity* entity) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Hash the identity of a client to find its bucket. The user name is
+    //! used if known, otherwise the user and the host of the trace
+    //! identifier, so that the connections of a client share the bucket.
+    //!
+    //! @param entity identity of the client, can be 0
+    //!
+    //! @return hash of the client
+    //!
+    //--------------------------------------------------------------------------
+    static uint32_t HashClient(const XrdSecEntity* entity);
+
+
+    //--------------------------------------------------------------------------
+    //! Request the admission of an existence check
+    //!
+    //! @param cls class index
+    //! @param client hash of the client
+    //!
+    //! @return verdict, if eAllowed Release must be called once the check
+    //!         is done
+    //!
+    //--------------------------------------------------------------------------
+    Verdict Admit(int cls, uint32_t client);
+
+
+    //--------------------------------------------------------------------------
+    //! Release an existence check admitted in a class
+    //!
+    //! @param cls class index
+    //!
+    //--------------------------------------------------------------------------
+    void Release(int cls);
+
+
+    //--------------------------------------------------------------------------
+    //! Get number of classes
+    //--------------------------------------------------------------------------
+    size_t GetNumClasses() const
+    {
+      return mClasses.size();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get class
+    //!
+    //! @param index class index
+    //!
+    //--------------------------------------------------------------------------
+    const Class& GetClass(size_t index) const
+    {
+      return *mClasses[index];
+    }
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Take a token from a bucket
+    //!
+    //! @param tat theoretical arrival time of the bucket
+    //! @param now_us current time in microseconds
+    //! @param interval_us time between two requests at the rate
+    //! @param tolerance_us burst expressed in time
+    //!
+    //! @return true if the request conforms to the rate, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool Take(std::atomic<uint64_t>& tat, uint64_t now_us,
+                     uint64_t interval_us, uint64_t tolerance_us);
+
+    std::vector<Class*> mClasses; ///< classes in the order they were added
+};
+
+#endif //__EOS_QOSTABLE_HH__
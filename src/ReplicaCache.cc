@@ -0,0 +1,227 @@
+// -----------------------------------------------------------------------------
+// File: ReplicaCache.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "ReplicaCache.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+#include <functional>
+#include <limits>
+/*----------------------------------------------------------------------------*/
+
+
+//------------------------------------------------------------------------------
+// Constuctor
+//------------------------------------------------------------------------------
+ReplicaCache::ReplicaCache(size_t max_entries, uint64_t ttl_us,
+                           uint32_t hot_lookups):
+  mMaxShardEntries((max_entries + sNumShards - 1) / sNumShards),
+  mTtlUs(ttl_us),
+  mHotLookups(hot_lookups ? hot_lookups : 1)
+{ }
+
+
+//------------------------------------------------------------------------------
+// Look up a replica of a file
+//------------------------------------------------------------------------------
+bool
+ReplicaCache::Get(const std::string& pfn, Replica& replica, bool& fetch)
+{
+  Shard& shard = GetShard(pfn);
+  uint64_t now_us = LatencyStats::NowUs();
+  XrdSysMutexHelper lock(shard.mutex);
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(pfn);
+  fetch = false;
+
+  if ((it != shard.entries.end()) && (it->second.expire_us > now_us))
+  {
+    Entry& entry = it->second;
+
+    if (entry.lookups)
+    {
+      shard.misses++;
+      Count(shard, entry, now_us, fetch);
+      return false;
+    }
+
+    // A fetch in progress or a file without known replicas
+    if (entry.pending || entry.replicas.empty())
+    {
+      shard.misses++;
+      return false;
+    }
+
+    replica = entry.replicas[entry.next++ % entry.replicas.size()];
+    shard.hits++;
+    return true;
+  }
+
+  shard.misses++;
+
+  // The lookups are counted from the first one until the entry expires
+  if ((it != shard.entries.end()) || MakeRoom(shard, now_us))
+  {
+    Entry& entry = shard.entries[pfn];
+    entry = Entry();
+    entry.expire_us = now_us + mTtlUs;
+    Count(shard, entry, now_us, fetch);
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Count a lookup of a file whose replicas are not requested yet
+//------------------------------------------------------------------------------
+void
+ReplicaCache::Count(Shard& shard, Entry& entry, uint64_t now_us, bool& fetch)
+{
+  if (++entry.lookups < mHotLookups)
+    return;
+
+  // The entry waits for the replicas until it expires, a fetch which never
+  // completes does not block the file for longer
+  entry.lookups = 0;
+  entry.pending = true;
+  entry.expire_us = now_us + mTtlUs;
+  shard.fetches++;
+  fetch = true;
+}
+
+
+//------------------------------------------------------------------------------
+// Store the replicas fetched for a file
+//------------------------------------------------------------------------------
+void
+ReplicaCache::Put(const std::string& pfn, const std::vector<Replica>& replicas)
+{
+  Shard& shard = GetShard(pfn);
+  uint64_t now_us = LatencyStats::NowUs();
+  XrdSysMutexHelper lock(shard.mutex);
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(pfn);
+
+  if ((it == shard.entries.end()) && !MakeRoom(shard, now_us))
+    return;
+
+  Entry& entry = shard.entries[pfn];
+  entry.expire_us = now_us + mTtlUs;
+  entry.pending = false;
+  entry.replicas = replicas;
+}
+
+
+//------------------------------------------------------------------------------
+// Get all the replicas of a file
+//------------------------------------------------------------------------------
+bool
+ReplicaCache::GetReplicas(const std::string& pfn,
+                          std::vector<Replica>& replicas)
+{
+  Shard& shard = GetShard(pfn);
+  uint64_t now_us = LatencyStats::NowUs();
+  XrdSysMutexHelper lock(shard.mutex);
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.find(pfn);
+
+  if ((it == shard.entries.end()) || (it->second.expire_us <= now_us))
+    return false;
+
+  replicas = it->second.replicas;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Drop the entry of a file
+//------------------------------------------------------------------------------
+void
+ReplicaCache::Erase(const std::string& pfn)
+{
+  Shard& shard = GetShard(pfn);
+  XrdSysMutexHelper lock(shard.mutex);
+  shard.entries.erase(pfn);
+}
+
+
+//------------------------------------------------------------------------------
+// Get the cache counters summed over all the shards
+//------------------------------------------------------------------------------
+void
+ReplicaCache::GetStats(Stats& stats)
+{
+  stats.hits = stats.misses = stats.fetches = stats.entries = 0;
+
+  for (size_t i = 0; i < sNumShards; ++i)
+  {
+    XrdSysMutexHelper lock(mShards[i].mutex);
+    stats.hits += mShards[i].hits;
+    stats.misses += mShards[i].misses;
+    stats.fetches += mShards[i].fetches;
+    stats.entries += mShards[i].entries.size();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Get the shard holding a pfn
+//------------------------------------------------------------------------------
+ReplicaCache::Shard&
+ReplicaCache::GetShard(const std::string& pfn)
+{
+  return mShards[std::hash<std::string>()(pfn) & (sNumShards - 1)];
+}
+
+
+//------------------------------------------------------------------------------
+// Drop the expired entries of a full shard
+//------------------------------------------------------------------------------
+bool
+ReplicaCache::MakeRoom(Shard& shard, uint64_t now_us)
+{
+  if (shard.entries.size() < mMaxShardEntries)
+    return true;
+
+  // Nothing expired since the last scan
+  if (now_us < shard.clean_us)
+    return false;
+
+  std::unordered_map<std::string, Entry>::iterator it = shard.entries.begin();
+  shard.clean_us = std::numeric_limits<uint64_t>::max();
+
+  while (it != shard.entries.end())
+  {
+    if (it->second.expire_us <= now_us)
+    {
+      it = shard.entries.erase(it);
+    }
+    else
+    {
+      if (it->second.expire_us < shard.clean_us)
+        shard.clean_us = it->second.expire_us;
+
+      ++it;
+    }
+  }
+
+  return (shard.entries.size() < mMaxShardEntries);
+}
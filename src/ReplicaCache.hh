@@ -0,0 +1,223 @@
+// -----------------------------------------------------------------------------
+// File: ReplicaCache.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_REPLICACACHE_HH__
+#define __EOS_REPLICACACHE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class ReplicaCache keeping for a short time the storage nodes holding the
+//! replicas of the files found in EOS. The lookups of a file are counted for
+//! the time to live of its entry and the one reaching the hotness threshold
+//! tells the caller to fetch its replicas, the following ones, until the entry
+//! expires, return the replicas in turn. The files looked up once, i.e. the
+//! cold ones, cost no replica request.
+//------------------------------------------------------------------------------
+class ReplicaCache
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Number of shards, must be a power of two
+    //--------------------------------------------------------------------------
+    static const size_t sNumShards = 16;
+
+
+    //--------------------------------------------------------------------------
+    //! Storage node holding a replica
+    //--------------------------------------------------------------------------
+    struct Replica
+    {
+      Replica(): port(0) { }
+
+      std::string host; ///< host name of the storage node
+      int port; ///< port of the storage node
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Cache counters
+    //--------------------------------------------------------------------------
+    struct Stats
+    {
+      uint64_t hits; ///< lookups which returned a replica
+      uint64_t misses; ///< lookups which found no usable entry
+      uint64_t fetches; ///< lookups which asked the caller to fetch replicas
+      uint64_t entries; ///< entries currently stored
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //!
+    //! @param max_entries maximum number of files in the cache
+    //! @param ttl_us time to live of an entry in microseconds
+    //! @param hot_lookups number of lookups of a file within the time to live
+    //!        after which its replicas are fetched, 1 fetches them on the
+    //!        first lookup
+    //!
+    //--------------------------------------------------------------------------
+    ReplicaCache(size_t max_entries, uint64_t ttl_us, uint32_t hot_lookups);
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~ReplicaCache() { }
+
+
+    //--------------------------------------------------------------------------
+    //! Look up a replica of a file
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //! @param replica set to the next replica of the file if found
+    //! @param fetch set to true if the caller must fetch the replicas of the
+    //!        file and Put them, an entry waiting for them is then created
+    //!
+    //! @return true if a replica was found, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Get(const std::string& pfn, Replica& replica, bool& fetch);
+
+
+    //--------------------------------------------------------------------------
+    //! Store the replicas fetched for a file. An empty list is kept as well so
+    //! that the replicas are not fetched again before the entry expires.
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //! @param replicas replicas of the file
+    //!
+    //--------------------------------------------------------------------------
+    void Put(const std::string& pfn, const std::vector<Replica>& replicas);
+
+
+    //--------------------------------------------------------------------------
+    //! Get all the replicas of a file, without counting a lookup
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //! @param replicas filled with the replicas of the file
+    //!
+    //! @return true if the file has an entry which did not expire
+    //!
+    //--------------------------------------------------------------------------
+    bool GetReplicas(const std::string& pfn, std::vector<Replica>& replicas);
+
+
+    //--------------------------------------------------------------------------
+    //! Drop the entry of a file
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //!
+    //--------------------------------------------------------------------------
+    void Erase(const std::string& pfn);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the cache counters summed over all the shards
+    //!
+    //! @param stats structure filled with the counters
+    //!
+    //--------------------------------------------------------------------------
+    void GetStats(Stats& stats);
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Cache entry
+    //--------------------------------------------------------------------------
+    struct Entry
+    {
+      Entry(): expire_us(0), lookups(0), pending(false), next(0) { }
+
+      uint64_t expire_us; ///< expiry time
+      uint32_t lookups; ///< lookups counted, 0 once the replicas are requested
+      bool pending; ///< true while the replicas are being fetched
+      uint32_t next; ///< index of the replica returned next
+      std::vector<Replica> replicas; ///< replicas of the file
+    };
+
+    //--------------------------------------------------------------------------
+    //! Shard of the cache
+    //--------------------------------------------------------------------------
+    struct Shard
+    {
+      Shard(): clean_us(0), hits(0), misses(0), fetches(0) { }
+
+      XrdSysMutex mutex; ///< mutex protecting the members below
+      std::unordered_map<std::string, Entry> entries; ///< entries by pfn
+      uint64_t clean_us; ///< earliest expiry time of the entries when full
+      uint64_t hits; ///< lookups which returned a replica
+      uint64_t misses; ///< lookups which found no usable entry
+      uint64_t fetches; ///< lookups which asked for the replicas
+    };
+
+    //--------------------------------------------------------------------------
+    //! Get the shard holding a pfn
+    //!
+    //! @param pfn full pfn of the file in EOS
+    //!
+    //! @return shard of the pfn
+    //!
+    //--------------------------------------------------------------------------
+    Shard& GetShard(const std::string& pfn);
+
+
+    //--------------------------------------------------------------------------
+    //! Count a lookup of a file whose replicas are not requested yet, the
+    //! caller holds the mutex of the shard
+    //!
+    //! @param shard shard holding the entry
+    //! @param entry entry of the file
+    //! @param now_us current time in microseconds
+    //! @param fetch set to true if the lookup reached the hotness threshold
+    //!
+    //--------------------------------------------------------------------------
+    void Count(Shard& shard, Entry& entry, uint64_t now_us, bool& fetch);
+
+
+    //--------------------------------------------------------------------------
+    //! Drop the expired entries of a full shard, the caller holds its mutex
+    //!
+    //! @param shard shard to clean
+    //! @param now_us current time in microseconds
+    //!
+    //! @return true if there is room for a new entry, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool MakeRoom(Shard& shard, uint64_t now_us);
+
+    size_t mMaxShardEntries; ///< maximum number of entries of a shard
+    uint64_t mTtlUs; ///< time to live of an entry in microseconds
+    uint32_t mHotLookups; ///< lookups after which the replicas are fetched
+    Shard mShards[sNumShards]; ///< shards selected by the hash of the pfn
+};
+
+#endif // __EOS_REPLICACACHE_HH__
@@ -0,0 +1,133 @@
+// -----------------------------------------------------------------------------
+// File: RouteTrie.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "RouteTrie.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+RouteTrie::RouteTrie():
+  mNodes(1)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+RouteTrie::~RouteTrie()
+{
+  for (auto it = mRules.begin(); it != mRules.end(); ++it)
+    delete *it;
+}
+
+
+//------------------------------------------------------------------------------
+// Get child of a node
+//------------------------------------------------------------------------------
+int
+RouteTrie::GetChild(int node, char c) const
+{
+  const std::vector< std::pair<char, int> >& children = mNodes[node].children;
+
+  for (auto it = children.begin(); it != children.end(); ++it)
+  {
+    if (it->first == c)
+      return it->second;
+  }
+
+  return -1;
+}
+
+
+//------------------------------------------------------------------------------
+// Add rule
+//------------------------------------------------------------------------------
+void
+RouteTrie::AddRule(const std::string& prefix, const std::vector<int>& tokens,
+                   bool others)
+{
+  int node = 0;
+
+  for (auto it = prefix.begin(); it != prefix.end(); ++it)
+  {
+    int child = GetChild(node, *it);
+
+    if (child < 0)
+    {
+      child = mNodes.size();
+      mNodes.push_back(Node());
+      mNodes[node].children.push_back(std::make_pair(*it, child));
+    }
+
+    node = child;
+  }
+
+  Rule* rule = new Rule();
+  rule->prefix = prefix;
+  rule->tokens = tokens;
+  rule->others = others;
+  rule->hits.store(0);
+
+  if (mNodes[node].rule >= 0)
+  {
+    delete mRules[mNodes[node].rule];
+    mRules[mNodes[node].rule] = rule;
+  }
+  else
+  {
+    mNodes[node].rule = mRules.size();
+    mRules.push_back(rule);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Find the rule with the longest prefix matching a scope
+//------------------------------------------------------------------------------
+const RouteTrie::Rule*
+RouteTrie::Match(const char* scope, size_t scope_len) const
+{
+  int node = 0;
+  int rule = mNodes[0].rule;
+
+  for (size_t i = 0; i < scope_len; ++i)
+  {
+    node = GetChild(node, scope[i]);
+
+    if (node < 0)
+      break;
+
+    if (mNodes[node].rule >= 0)
+      rule = mNodes[node].rule;
+  }
+
+  if (rule < 0)
+    return 0;
+
+  mRules[rule]->hits.fetch_add(1, std::memory_order_relaxed);
+  return mRules[rule];
+}
@@ -0,0 +1,143 @@
+// -----------------------------------------------------------------------------
+// File: RouteTrie.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_ROUTETRIE_HH__
+#define __EOS_ROUTETRIE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class RouteTrie holding the static routing rules which map a Rucio scope
+//! prefix to the space tokens where the files of the scope can be. The rules
+//! are compiled into a prefix trie so that the longest matching prefix of a
+//! scope is found in one pass over the scope. The rules are added during the
+//! configuration and the trie is read-only afterwards.
+//------------------------------------------------------------------------------
+class RouteTrie
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Routing rule
+    //--------------------------------------------------------------------------
+    struct Rule
+    {
+      std::string prefix; ///< scope prefix
+      std::vector<int> tokens; ///< token indices to probe in this order
+      bool others; ///< true if the other tokens are probed afterwards
+      mutable std::atomic<uint64_t> hits; ///< scopes matched by the rule
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    RouteTrie();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~RouteTrie();
+
+
+    //--------------------------------------------------------------------------
+    //! Add rule - a rule for the same prefix replaces the previous one
+    //!
+    //! @param prefix scope prefix, can be empty to match every scope
+    //! @param tokens token indices to probe in this order
+    //! @param others if true, the other tokens are probed afterwards
+    //!
+    //--------------------------------------------------------------------------
+    void AddRule(const std::string& prefix, const std::vector<int>& tokens,
+                 bool others);
+
+
+    //--------------------------------------------------------------------------
+    //! Find the rule with the longest prefix matching a scope and count the
+    //! hit
+    //!
+    //! @param scope start of the scope
+    //! @param scope_len length of the scope
+    //!
+    //! @return matching rule or 0 if none
+    //!
+    //--------------------------------------------------------------------------
+    const Rule* Match(const char* scope, size_t scope_len) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Get number of rules
+    //--------------------------------------------------------------------------
+    size_t GetNumRules() const
+    {
+      return mRules.size();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get rule
+    //!
+    //! @param index rule index
+    //!
+    //--------------------------------------------------------------------------
+    const Rule& GetRule(size_t index) const
+    {
+      return *mRules[index];
+    }
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Trie node
+    //--------------------------------------------------------------------------
+    struct Node
+    {
+      Node(): rule(-1) { }
+
+      std::vector< std::pair<char, int> > children; ///< next char and node
+      int rule; ///< index of the rule ending in this node or -1
+    };
+
+    //--------------------------------------------------------------------------
+    //! Get child of a node
+    //!
+    //! @param node node index
+    //! @param c next character
+    //!
+    //! @return index of the child or -1 if none
+    //!
+    //--------------------------------------------------------------------------
+    int GetChild(int node, char c) const;
+
+    std::vector<Node> mNodes; ///< trie nodes, the root is the first one
+    std::vector<Rule*> mRules; ///< rules in the order they were added
+};
+
+#endif //__EOS_ROUTETRIE_HH__
@@ -0,0 +1,274 @@
+// -----------------------------------------------------------------------------
+// File: RucioMd5.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "RucioMd5.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstring>
+#include <cpuid.h>
+#include <nmmintrin.h>
+/*----------------------------------------------------------------------------*/
+
+const uint32_t RucioMd5::sK[64] =
+{
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+  0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+  0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+  0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+  0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+  0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const uint32_t RucioMd5::sShift[64] =
+{
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+const uint32_t RucioMd5::sIndex[64] =
+{
+  0, 1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+  1, 6, 11,  0,  5, 10, 15,  4,  9, 14,  3,  8, 13,  2,  7, 12,
+  5, 8, 11, 14,  1,  4,  7, 10, 13,  0,  3,  6,  9, 12, 15,  2,
+  0, 7, 14,  5, 12,  3, 10,  1,  8, 15,  6, 13,  4, 11,  2,  9
+};
+
+
+//------------------------------------------------------------------------------
+// Compute the MD5 digests of a list of messages
+//------------------------------------------------------------------------------
+void
+RucioMd5::Digest(const unsigned char* const* msgs,
+                 const size_t* lens,
+                 size_t num,
+                 unsigned char (*digests)[MD5_DIGEST_LENGTH])
+{
+  size_t lanes = Lanes();
+
+  for (size_t pos = 0; pos < num; pos += lanes)
+  {
+    size_t count = ((num - pos < lanes) ? (num - pos) : lanes);
+
+    // A single message is faster through the scalar implementation
+    if (count == 1)
+    {
+      MD5(msgs[pos], lens[pos], digests[pos]);
+      continue;
+    }
+
+#ifdef HAVE_AVX2
+
+    if (lanes == 8)
+    {
+      Digest8(msgs + pos, lens + pos, count, digests + pos);
+      continue;
+    }
+
+#endif
+    Digest4(msgs + pos, lens + pos, count, digests + pos);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Get the number of lanes used by the implementation selected at runtime
+//------------------------------------------------------------------------------
+unsigned int
+RucioMd5::Lanes()
+{
+  static const unsigned int lanes = (DetectAvx2() ? 8 : 4);
+  return lanes;
+}
+
+
+//------------------------------------------------------------------------------
+// Fill in one 64 bytes block of the MD5 padded message
+//------------------------------------------------------------------------------
+void
+RucioMd5::FillBlock(const unsigned char* msg, size_t len, size_t index,
+                    uint32_t* block)
+{
+  unsigned char* out = reinterpret_cast<unsigned char*>(block);
+  size_t offset = index * 64;
+  memset(out, 0, 64);
+
+  if (offset < len)
+  {
+    size_t nbytes = ((len - offset < 64) ? (len - offset) : 64);
+    memcpy(out, msg + offset, nbytes);
+
+    if (nbytes < 64)
+      out[nbytes] = 0x80;
+  }
+  else if (offset == len)
+  {
+    out[0] = 0x80;
+  }
+
+  // The message length in bits goes at the end of the last block
+  if (index == NumBlocks(len) - 1)
+  {
+    uint64_t nbits = static_cast<uint64_t>(len) << 3;
+    memcpy(out + 56, &nbits, sizeof(nbits));
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Compute up to 4 digests using SSE
+//------------------------------------------------------------------------------
+void
+RucioMd5::Digest4(const unsigned char* const* msgs,
+                  const size_t* lens,
+                  size_t num,
+                  unsigned char (*digests)[MD5_DIGEST_LENGTH])
+{
+  size_t nblocks[4] = {0, 0, 0, 0};
+  size_t max_blocks = 0;
+  uint32_t block[4][16] __attribute__((aligned(16)));
+  uint32_t active[4] __attribute__((aligned(16)));
+  const __m128i ones = _mm_set1_epi32(-1);
+  memset(block, 0, sizeof(block));
+
+  for (size_t lane = 0; lane < num; ++lane)
+  {
+    nblocks[lane] = NumBlocks(lens[lane]);
+
+    if (nblocks[lane] > max_blocks)
+      max_blocks = nblocks[lane];
+  }
+
+  __m128i a = _mm_set1_epi32(0x67452301);
+  __m128i b = _mm_set1_epi32(0xefcdab89);
+  __m128i c = _mm_set1_epi32(0x98badcfe);
+  __m128i d = _mm_set1_epi32(0x10325476);
+
+  for (size_t blk = 0; blk < max_blocks; ++blk)
+  {
+    // Lanes whose message is already consumed keep their state unchanged
+    for (size_t lane = 0; lane < 4; ++lane)
+    {
+      if ((lane < num) && (blk < nblocks[lane]))
+      {
+        FillBlock(msgs[lane], lens[lane], blk, block[lane]);
+        active[lane] = 0xffffffff;
+      }
+      else
+      {
+        active[lane] = 0;
+      }
+    }
+
+    __m128i m[16];
+
+    for (int w = 0; w < 16; ++w)
+      m[w] = _mm_set_epi32(block[3][w], block[2][w], block[1][w], block[0][w]);
+
+    __m128i aa = a, bb = b, cc = c, dd = d, f;
+
+    for (int i = 0; i < 64; ++i)
+    {
+      if (i < 16)
+        f = _mm_xor_si128(dd, _mm_and_si128(bb, _mm_xor_si128(cc, dd)));
+      else if (i < 32)
+        f = _mm_xor_si128(cc, _mm_and_si128(dd, _mm_xor_si128(bb, cc)));
+      else if (i < 48)
+        f = _mm_xor_si128(bb, _mm_xor_si128(cc, dd));
+      else
+        f = _mm_xor_si128(cc, _mm_or_si128(bb, _mm_xor_si128(dd, ones)));
+
+      __m128i t = _mm_add_epi32(_mm_add_epi32(aa, f),
+                                _mm_add_epi32(m[sIndex[i]], _mm_set1_epi32(sK[i])));
+      t = _mm_or_si128(_mm_sll_epi32(t, _mm_cvtsi32_si128(sShift[i])),
+                       _mm_srl_epi32(t, _mm_cvtsi32_si128(32 - sShift[i])));
+      aa = dd;
+      dd = cc;
+      cc = bb;
+      bb = _mm_add_epi32(bb, t);
+    }
+
+    __m128i mask = _mm_load_si128(reinterpret_cast<__m128i*>(active));
+    a = _mm_add_epi32(a, _mm_and_si128(mask, aa));
+    b = _mm_add_epi32(b, _mm_and_si128(mask, bb));
+    c = _mm_add_epi32(c, _mm_and_si128(mask, cc));
+    d = _mm_add_epi32(d, _mm_and_si128(mask, dd));
+  }
+
+  uint32_t state[4][4] __attribute__((aligned(16)));
+  _mm_store_si128(reinterpret_cast<__m128i*>(state[0]), a);
+  _mm_store_si128(reinterpret_cast<__m128i*>(state[1]), b);
+  _mm_store_si128(reinterpret_cast<__m128i*>(state[2]), c);
+  _mm_store_si128(reinterpret_cast<__m128i*>(state[3]), d);
+
+  for (size_t lane = 0; lane < num; ++lane)
+  {
+    for (int word = 0; word < 4; ++word)
+      memcpy(&digests[lane][word * 4], &state[word][lane], 4);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Check if the CPU and the OS support AVX2
+//------------------------------------------------------------------------------
+bool
+RucioMd5::DetectAvx2()
+{
+#ifdef HAVE_AVX2
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  // Need both OSXSAVE and AVX
+  if (!(ecx & (1 << 27)) || !(ecx & (1 << 28)))
+    return false;
+
+  // The OS must save the XMM and YMM registers on context switch
+  uint32_t xcr0_lo, xcr0_hi;
+  __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+
+  if ((xcr0_lo & 0x6) != 0x6)
+    return false;
+
+  if (__get_cpuid_max(0, 0) < 7)
+    return false;
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return ((ebx & (1 << 5)) != 0);
+#else
+  return false;
+#endif
+}
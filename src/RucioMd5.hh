@@ -0,0 +1,145 @@
+// -----------------------------------------------------------------------------
+// File: RucioMd5.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_RUCIOMD5_HH__
+#define __EOS_RUCIOMD5_HH__
+
+/*----------------------------------------------------------------------------*/
+#include <cstddef>
+#include <stdint.h>
+#include <openssl/md5.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class RucioMd5 computing the MD5 digests of several messages at once by
+//! interleaving them in the lanes of the SIMD registers. The SSE version
+//! processes 4 messages in parallel while the AVX2 one, selected at runtime
+//! if the CPU supports it, processes 8 messages in parallel.
+//------------------------------------------------------------------------------
+class RucioMd5
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Maximum number of lanes supported by any of the implementations
+    //--------------------------------------------------------------------------
+    static const unsigned int sMaxLanes = 8;
+
+
+    //--------------------------------------------------------------------------
+    //! Compute the MD5 digests of a list of messages
+    //!
+    //! @param msgs array of pointers to the messages
+    //! @param lens array of message lengths
+    //! @param num number of messages
+    //! @param digests array of num digests to be filled
+    //!
+    //--------------------------------------------------------------------------
+    static void Digest(const unsigned char* const* msgs,
+                       const size_t* lens,
+                       size_t num,
+                       unsigned char (*digests)[MD5_DIGEST_LENGTH]);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of lanes used by the implementation selected at runtime
+    //!
+    //! @return 8 if AVX2 is available, otherwise 4
+    //!
+    //--------------------------------------------------------------------------
+    static unsigned int Lanes();
+
+
+    //--------------------------------------------------------------------------
+    //! Fill in one 64 bytes block of the MD5 padded message
+    //!
+    //! @param msg message
+    //! @param len length of the message
+    //! @param index index of the block to fill in
+    //! @param block block to be filled
+    //!
+    //--------------------------------------------------------------------------
+    static void FillBlock(const unsigned char* msg, size_t len, size_t index,
+                          uint32_t* block);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the number of 64 bytes blocks in the MD5 padded message
+    //!
+    //! @param len length of the message
+    //!
+    //! @return number of blocks
+    //!
+    //--------------------------------------------------------------------------
+    static inline size_t NumBlocks(size_t len)
+    {
+      return (len + 8) / 64 + 1;
+    }
+
+    static const uint32_t sK[64]; ///< MD5 additive constants
+    static const uint32_t sShift[64]; ///< MD5 per step rotation amounts
+    static const uint32_t sIndex[64]; ///< MD5 per step message word index
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Compute up to 4 digests using SSE
+    //!
+    //! @param msgs array of pointers to the messages
+    //! @param lens array of message lengths
+    //! @param num number of messages, at most 4
+    //! @param digests array of num digests to be filled
+    //!
+    //--------------------------------------------------------------------------
+    static void Digest4(const unsigned char* const* msgs,
+                        const size_t* lens,
+                        size_t num,
+                        unsigned char (*digests)[MD5_DIGEST_LENGTH]);
+
+
+    //--------------------------------------------------------------------------
+    //! Compute up to 8 digests using AVX2 - only available if the compiler
+    //! supports it, the caller must check that the CPU supports it.
+    //!
+    //! @param msgs array of pointers to the messages
+    //! @param lens array of message lengths
+    //! @param num number of messages, at most 8
+    //! @param digests array of num digests to be filled
+    //!
+    //--------------------------------------------------------------------------
+    static void Digest8(const unsigned char* const* msgs,
+                        const size_t* lens,
+                        size_t num,
+                        unsigned char (*digests)[MD5_DIGEST_LENGTH]);
+
+
+    //--------------------------------------------------------------------------
+    //! Check if the CPU and the OS support AVX2
+    //!
+    //! @return true if AVX2 can be used, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    static bool DetectAvx2();
+};
+
+#endif //__EOS_RUCIOMD5_HH__
@@ -0,0 +1,130 @@
+// -----------------------------------------------------------------------------
+// File: RucioMd5Avx2.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+//------------------------------------------------------------------------------
+// This file is compiled with -mavx2 and the code in it is only called after
+// RucioMd5::DetectAvx2 confirmed that the CPU supports AVX2.
+//------------------------------------------------------------------------------
+
+/*----------------------------------------------------------------------------*/
+#include "RucioMd5.hh"
+/*----------------------------------------------------------------------------*/
+#include <cstring>
+#include <immintrin.h>
+/*----------------------------------------------------------------------------*/
+
+
+//------------------------------------------------------------------------------
+// Compute up to 8 digests using AVX2
+//------------------------------------------------------------------------------
+void
+RucioMd5::Digest8(const unsigned char* const* msgs,
+                  const size_t* lens,
+                  size_t num,
+                  unsigned char (*digests)[MD5_DIGEST_LENGTH])
+{
+  size_t nblocks[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  size_t max_blocks = 0;
+  uint32_t block[8][16] __attribute__((aligned(32)));
+  uint32_t active[8] __attribute__((aligned(32)));
+  const __m256i ones = _mm256_set1_epi32(-1);
+  memset(block, 0, sizeof(block));
+
+  for (size_t lane = 0; lane < num; ++lane)
+  {
+    nblocks[lane] = NumBlocks(lens[lane]);
+
+    if (nblocks[lane] > max_blocks)
+      max_blocks = nblocks[lane];
+  }
+
+  __m256i a = _mm256_set1_epi32(0x67452301);
+  __m256i b = _mm256_set1_epi32(0xefcdab89);
+  __m256i c = _mm256_set1_epi32(0x98badcfe);
+  __m256i d = _mm256_set1_epi32(0x10325476);
+
+  for (size_t blk = 0; blk < max_blocks; ++blk)
+  {
+    // Lanes whose message is already consumed keep their state unchanged
+    for (size_t lane = 0; lane < 8; ++lane)
+    {
+      if ((lane < num) && (blk < nblocks[lane]))
+      {
+        FillBlock(msgs[lane], lens[lane], blk, block[lane]);
+        active[lane] = 0xffffffff;
+      }
+      else
+      {
+        active[lane] = 0;
+      }
+    }
+
+    __m256i m[16];
+
+    for (int w = 0; w < 16; ++w)
+      m[w] = _mm256_set_epi32(block[7][w], block[6][w], block[5][w], block[4][w],
+                              block[3][w], block[2][w], block[1][w], block[0][w]);
+
+    __m256i aa = a, bb = b, cc = c, dd = d, f;
+
+    for (int i = 0; i < 64; ++i)
+    {
+      if (i < 16)
+        f = _mm256_xor_si256(dd, _mm256_and_si256(bb, _mm256_xor_si256(cc, dd)));
+      else if (i < 32)
+        f = _mm256_xor_si256(cc, _mm256_and_si256(dd, _mm256_xor_si256(bb, cc)));
+      else if (i < 48)
+        f = _mm256_xor_si256(bb, _mm256_xor_si256(cc, dd));
+      else
+        f = _mm256_xor_si256(cc, _mm256_or_si256(bb, _mm256_xor_si256(dd, ones)));
+
+      __m256i t = _mm256_add_epi32(_mm256_add_epi32(aa, f),
+                                   _mm256_add_epi32(m[sIndex[i]],
+                                       _mm256_set1_epi32(sK[i])));
+      t = _mm256_or_si256(_mm256_sll_epi32(t, _mm_cvtsi32_si128(sShift[i])),
+                          _mm256_srl_epi32(t, _mm_cvtsi32_si128(32 - sShift[i])));
+      aa = dd;
+      dd = cc;
+      cc = bb;
+      bb = _mm256_add_epi32(bb, t);
+    }
+
+    __m256i mask = _mm256_load_si256(reinterpret_cast<__m256i*>(active));
+    a = _mm256_add_epi32(a, _mm256_and_si256(mask, aa));
+    b = _mm256_add_epi32(b, _mm256_and_si256(mask, bb));
+    c = _mm256_add_epi32(c, _mm256_and_si256(mask, cc));
+    d = _mm256_add_epi32(d, _mm256_and_si256(mask, dd));
+  }
+
+  uint32_t state[4][8] __attribute__((aligned(32)));
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[0]), a);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[1]), b);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[2]), c);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[3]), d);
+
+  for (size_t lane = 0; lane < num; ++lane)
+  {
+    for (int word = 0; word < 4; ++word)
+      memcpy(&digests[lane][word * 4], &state[word][lane], 4);
+  }
+}
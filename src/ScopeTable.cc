@@ -0,0 +1,203 @@
+// -----------------------------------------------------------------------------
+// File: ScopeTable.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "ScopeTable.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Entry layout helpers
+//------------------------------------------------------------------------------
+static inline uint32_t
+EntryTag(uint64_t entry)
+{
+  return static_cast<uint32_t>(entry >> 32);
+}
+
+static inline int
+EntryToken(uint64_t entry)
+{
+  return static_cast<int>((entry >> 16) & 0xffff);
+}
+
+static inline unsigned int
+EntryConfidence(uint64_t entry)
+{
+  return static_cast<unsigned int>(entry & 0xffff);
+}
+
+static inline uint64_t
+MakeEntry(uint32_t tag, int token, unsigned int confidence)
+{
+  return ((static_cast<uint64_t>(tag) << 32) |
+          (static_cast<uint64_t>(token & 0xffff) << 16) | confidence);
+}
+
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+ScopeTable::ScopeTable(size_t num_entries):
+  mNumSets((num_entries + sSetSize - 1) / sSetSize)
+{
+  if (mNumSets == 0)
+    mNumSets = 1;
+
+  mEntries = new std::atomic<uint64_t>[mNumSets * sSetSize];
+
+  for (size_t i = 0; i < mNumSets * sSetSize; ++i)
+    mEntries[i].store(0, std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+ScopeTable::~ScopeTable()
+{
+  delete[] mEntries;
+}
+
+
+//------------------------------------------------------------------------------
+// Hash a scope
+//------------------------------------------------------------------------------
+std::atomic<uint64_t>*
+ScopeTable::GetSet(const char* scope, size_t scope_len, uint32_t& tag) const
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < scope_len; ++i)
+  {
+    hash ^= static_cast<unsigned char>(scope[i]);
+    hash *= 1099511628211ULL;
+  }
+
+  // Tag 0 marks an empty entry
+  tag = static_cast<uint32_t>(hash >> 32);
+
+  if (!tag)
+    tag = 1;
+
+  return mEntries + (hash % mNumSets) * sSetSize;
+}
+
+
+//------------------------------------------------------------------------------
+// Get the space token predicted for a scope
+//------------------------------------------------------------------------------
+int
+ScopeTable::Predict(const char* scope, size_t scope_len) const
+{
+  uint32_t tag;
+  std::atomic<uint64_t>* set = GetSet(scope, scope_len, tag);
+
+  for (size_t i = 0; i < sSetSize; ++i)
+  {
+    uint64_t entry = set[i].load(std::memory_order_relaxed);
+
+    if (EntryTag(entry) == tag)
+    {
+      if (EntryConfidence(entry) >= sMinConfidence)
+        return EntryToken(entry);
+
+      break;
+    }
+  }
+
+  return -1;
+}
+
+
+//------------------------------------------------------------------------------
+// Account for a file of the scope found in a space token
+//------------------------------------------------------------------------------
+void
+ScopeTable::Update(const char* scope, size_t scope_len, int token)
+{
+  uint32_t tag;
+  std::atomic<uint64_t>* set = GetSet(scope, scope_len, tag);
+  std::atomic<uint64_t>* victim = set;
+  uint64_t victim_entry = set[0].load(std::memory_order_relaxed);
+
+  for (size_t i = 0; i < sSetSize; ++i)
+  {
+    uint64_t entry = set[i].load(std::memory_order_relaxed);
+
+    if (EntryTag(entry) == tag)
+    {
+      unsigned int confidence = EntryConfidence(entry);
+      uint64_t update;
+
+      if (EntryToken(entry) == token)
+      {
+        if (confidence >= sMaxConfidence)
+          return;
+
+        update = MakeEntry(tag, token, confidence + 1);
+      }
+      else if (confidence > 1)
+      {
+        update = MakeEntry(tag, EntryToken(entry), confidence - 1);
+      }
+      else
+      {
+        update = MakeEntry(tag, token, 1);
+      }
+
+      set[i].compare_exchange_strong(entry, update, std::memory_order_relaxed);
+      return;
+    }
+
+    // Prefer an empty entry, otherwise the least confident one
+    if (EntryTag(victim_entry) &&
+        (!EntryTag(entry) ||
+         (EntryConfidence(entry) < EntryConfidence(victim_entry))))
+    {
+      victim = &set[i];
+      victim_entry = entry;
+    }
+  }
+
+  victim->compare_exchange_strong(victim_entry, MakeEntry(tag, token, 1),
+                                  std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Get number of entries in use
+//------------------------------------------------------------------------------
+size_t
+ScopeTable::GetNumUsed() const
+{
+  size_t num_used = 0;
+
+  for (size_t i = 0; i < mNumSets * sSetSize; ++i)
+  {
+    if (EntryTag(mEntries[i].load(std::memory_order_relaxed)))
+      num_used++;
+  }
+
+  return num_used;
+}
@@ -0,0 +1,139 @@
+// -----------------------------------------------------------------------------
+// File: ScopeTable.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_SCOPETABLE_HH__
+#define __EOS_SCOPETABLE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class ScopeTable learning which space token usually holds the files of a
+//! Rucio scope. Each entry packs in one 64-bit word a tag of the scope hash,
+//! the predicted token and a saturating confidence counter which grows when
+//! a file of the scope is found in the predicted token and shrinks otherwise,
+//! the prediction switching to the new token when it drops to zero. Entries
+//! are updated with compare-and-swap so lookups and updates never lock and
+//! an update lost in a race only delays the learning.
+//!
+//! The table has a fixed number of entries grouped in sets of sSetSize. When
+//! a set is full, the entry with the lowest confidence is replaced.
+//------------------------------------------------------------------------------
+class ScopeTable
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Number of entries scanned for a scope
+    //--------------------------------------------------------------------------
+    static const size_t sSetSize = 4;
+
+
+    //--------------------------------------------------------------------------
+    //! Minimum confidence of an entry to be used as prediction
+    //--------------------------------------------------------------------------
+    static const unsigned int sMinConfidence = 2;
+
+
+    //--------------------------------------------------------------------------
+    //! Maximum confidence of an entry
+    //--------------------------------------------------------------------------
+    static const unsigned int sMaxConfidence = 16;
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //!
+    //! @param num_entries number of entries, rounded up to a multiple of
+    //!        sSetSize
+    //!
+    //--------------------------------------------------------------------------
+    ScopeTable(size_t num_entries);
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~ScopeTable();
+
+
+    //--------------------------------------------------------------------------
+    //! Get the space token predicted for a scope
+    //!
+    //! @param scope start of the scope
+    //! @param scope_len length of the scope
+    //!
+    //! @return token index or -1 if there is no confident prediction
+    //!
+    //--------------------------------------------------------------------------
+    int Predict(const char* scope, size_t scope_len) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Account for a file of the scope found in a space token
+    //!
+    //! @param scope start of the scope
+    //! @param scope_len length of the scope
+    //! @param token index of the token holding the file
+    //!
+    //--------------------------------------------------------------------------
+    void Update(const char* scope, size_t scope_len, int token);
+
+
+    //--------------------------------------------------------------------------
+    //! Get number of entries in use
+    //--------------------------------------------------------------------------
+    size_t GetNumUsed() const;
+
+
+    //--------------------------------------------------------------------------
+    //! Get total number of entries
+    //--------------------------------------------------------------------------
+    size_t GetCapacity() const
+    {
+      return mNumSets * sSetSize;
+    }
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Hash a scope
+    //!
+    //! @param scope start of the scope
+    //! @param scope_len length of the scope
+    //! @param tag set to the non-zero tag stored in the entry
+    //!
+    //! @return first entry of the set of the scope
+    //!
+    //--------------------------------------------------------------------------
+    std::atomic<uint64_t>* GetSet(const char* scope, size_t scope_len,
+                                  uint32_t& tag) const;
+
+    size_t mNumSets; ///< number of sets
+    std::atomic<uint64_t>* mEntries; ///< entries, tag:32 token:16 confidence:16
+};
+
+#endif //__EOS_SCOPETABLE_HH__
@@ -0,0 +1,192 @@
+// -----------------------------------------------------------------------------
+// File: SingleFlight.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "SingleFlight.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Check in progress for a digest
+//------------------------------------------------------------------------------
+struct SingleFlight::Flight
+{
+  Flight(): mRefs(2), mNumWaiters(0), mDone(false) { }
+
+  XrdSysCondVar mCond; ///< cond. variable protecting the members below
+  int mRefs; ///< references held by the map, the leader and the followers
+  size_t mNumWaiters; ///< number of followers
+  bool mDone; ///< true once the leader published the result
+  SingleFlight::Result mResult; ///< outcome of the check
+  std::vector<Waiter*> mWaiters; ///< followers notified on completion
+};
+
+
+//------------------------------------------------------------------------------
+// Build the key of a check in the map
+//------------------------------------------------------------------------------
+std::string
+SingleFlight::MakeKey(const unsigned char* digest, int tag)
+{
+  std::string key(reinterpret_cast<const char*>(digest), MD5_DIGEST_LENGTH);
+
+  if (tag >= 0)
+    key.append(reinterpret_cast<const char*>(&tag), sizeof(tag));
+
+  return key;
+}
+
+
+//------------------------------------------------------------------------------
+// Join the check for a digest
+//------------------------------------------------------------------------------
+SingleFlight::Flight*
+SingleFlight::Join(const unsigned char* digest, bool& leader, int tag)
+{
+  std::string key = MakeKey(digest, tag);
+  XrdSysMutexHelper scope_lock(mMutex);
+  auto it = mFlights.find(key);
+
+  if (it == mFlights.end())
+  {
+    // One reference for the map and one for the leader
+    Flight* flight = new Flight();
+    mFlights[key] = flight;
+    leader = true;
+    return flight;
+  }
+
+  // The follower reference is taken while the map lock is held so that the
+  // flight can not go away in the meantime
+  Flight* flight = it->second;
+  flight->mCond.Lock();
+  flight->mRefs++;
+  flight->mNumWaiters++;
+  flight->mCond.UnLock();
+  leader = false;
+  return flight;
+}
+
+
+//------------------------------------------------------------------------------
+// Join the check for a digest as a follower
+//------------------------------------------------------------------------------
+SingleFlight::Flight*
+SingleFlight::Follow(const unsigned char* digest, int tag)
+{
+  std::string key = MakeKey(digest, tag);
+  XrdSysMutexHelper scope_lock(mMutex);
+  auto it = mFlights.find(key);
+
+  if (it == mFlights.end())
+    return 0;
+
+  Flight* flight = it->second;
+  flight->mCond.Lock();
+  flight->mRefs++;
+  flight->mNumWaiters++;
+  flight->mCond.UnLock();
+  return flight;
+}
+
+
+//------------------------------------------------------------------------------
+// Wait for the leader to complete the check
+//------------------------------------------------------------------------------
+SingleFlight::Result
+SingleFlight::Wait(Flight* flight)
+{
+  flight->mCond.Lock();
+
+  while (!flight->mDone)
+    flight->mCond.Wait();
+
+  Result result = flight->mResult;
+  Unref(flight);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+// Register a follower to be notified when the leader completes the check
+//------------------------------------------------------------------------------
+void
+SingleFlight::Wait(Flight* flight, Waiter* waiter)
+{
+  flight->mCond.Lock();
+
+  if (!flight->mDone)
+  {
+    // The reference of the follower is dropped by Complete
+    flight->mWaiters.push_back(waiter);
+    flight->mCond.UnLock();
+    return;
+  }
+
+  Result result = flight->mResult;
+  Unref(flight);
+  waiter->FlightDone(result);
+}
+
+
+//------------------------------------------------------------------------------
+// Publish the outcome of the check and wake up the followers
+//------------------------------------------------------------------------------
+size_t
+SingleFlight::Complete(const unsigned char* digest, Flight* flight,
+                       const Result& result, int tag)
+{
+  std::string key = MakeKey(digest, tag);
+  // Callers arriving from now on start a new check
+  mMutex.Lock();
+  mFlights.erase(key);
+  mMutex.UnLock();
+  flight->mCond.Lock();
+  flight->mResult = result;
+  flight->mDone = true;
+  flight->mRefs--; // reference of the map
+  size_t num_waiters = flight->mNumWaiters;
+  std::vector<Waiter*> waiters;
+  waiters.swap(flight->mWaiters);
+  flight->mRefs -= waiters.size();
+  flight->mCond.Broadcast();
+  Unref(flight);
+
+  for (auto it = waiters.begin(); it != waiters.end(); ++it)
+    (*it)->FlightDone(result);
+
+  return num_waiters;
+}
+
+
+//------------------------------------------------------------------------------
+// Drop one reference to a flight
+//------------------------------------------------------------------------------
+void
+SingleFlight::Unref(Flight* flight)
+{
+  bool last = (--flight->mRefs == 0);
+  flight->mCond.UnLock();
+
+  if (last)
+    delete flight;
+}
@@ -0,0 +1,191 @@
+// -----------------------------------------------------------------------------
+// File: SingleFlight.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_SINGLEFLIGHT_HH__
+#define __EOS_SINGLEFLIGHT_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <map>
+#include <stdint.h>
+#include <vector>
+#include <openssl/md5.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class SingleFlight coalescing the concurrent existence checks for the same
+//! Rucio key. The first caller for a digest becomes the leader and does the
+//! check while the callers arriving before it completes wait for its result.
+//! Checks of the same digest whose outcomes differ, e.g. because they probe
+//! fewer space tokens, are told apart by a tag.
+//------------------------------------------------------------------------------
+class SingleFlight
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Check in progress for a digest
+    //--------------------------------------------------------------------------
+    struct Flight;
+
+
+    //--------------------------------------------------------------------------
+    //! Outcome of an existence check
+    //--------------------------------------------------------------------------
+    struct Result
+    {
+      Result(): endpoint(-1), has_stat(false), size(0), mtime(0), flags(0),
+        ino(0)
+      { }
+
+      std::string pfn; ///< full pfn found in EOS, empty if not found
+      int endpoint; ///< EOS endpoint which confirmed the file, -1 if none
+      bool has_stat; ///< true if the members below come from the EOS stat
+      uint64_t size; ///< size of the file
+      uint64_t mtime; ///< modification time of the file
+      uint32_t flags; ///< XrdCl::StatInfo flags of the file
+      uint64_t ino; ///< inode number derived from the Rucio digest
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Interface of a follower which does not block waiting for the result
+    //--------------------------------------------------------------------------
+    class Waiter
+    {
+      public:
+
+        virtual ~Waiter() { }
+
+        //----------------------------------------------------------------------
+        //! Called once, without any lock held, with the outcome of the check
+        //!
+        //! @param result outcome of the check as passed by the leader
+        //!
+        //----------------------------------------------------------------------
+        virtual void FlightDone(const Result& result) = 0;
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    SingleFlight() { };
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~SingleFlight() { };
+
+
+    //--------------------------------------------------------------------------
+    //! Join the check for a digest, starting a new one if none is in progress
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param leader set to true if the caller must do the check and then call
+    //!        Complete, otherwise the caller must call Wait
+    //! @param tag kind of check, -1 for the default one
+    //!
+    //! @return check in progress for the digest
+    //!
+    //--------------------------------------------------------------------------
+    Flight* Join(const unsigned char* digest, bool& leader, int tag = -1);
+
+
+    //--------------------------------------------------------------------------
+    //! Join the check for a digest as a follower, only if one is in progress
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param tag kind of check, -1 for the default one
+    //!
+    //! @return check in progress for the digest, the caller must call Wait,
+    //!         or 0 if none
+    //!
+    //--------------------------------------------------------------------------
+    Flight* Follow(const unsigned char* digest, int tag = -1);
+
+
+    //--------------------------------------------------------------------------
+    //! Wait for the leader to complete the check - the flight must not be used
+    //! after this call
+    //!
+    //! @param flight check joined as a follower
+    //!
+    //! @return outcome of the check as passed by the leader to Complete
+    //!
+    //--------------------------------------------------------------------------
+    Result Wait(Flight* flight);
+
+
+    //--------------------------------------------------------------------------
+    //! Register a follower to be notified when the leader completes the check
+    //! - the flight must not be used after this call. If the result is already
+    //! known, the follower is notified from this call.
+    //!
+    //! @param flight check joined as a follower
+    //! @param waiter object notified with the result
+    //!
+    //--------------------------------------------------------------------------
+    void Wait(Flight* flight, Waiter* waiter);
+
+
+    //--------------------------------------------------------------------------
+    //! Publish the outcome of the check and wake up the followers - the flight
+    //! must not be used after this call
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param flight check joined as the leader
+    //! @param result outcome of the check
+    //! @param tag kind of check given to Join
+    //!
+    //! @return number of followers which got the result
+    //!
+    //--------------------------------------------------------------------------
+    size_t Complete(const unsigned char* digest, Flight* flight,
+                    const Result& result, int tag = -1);
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Build the key of a check in the map
+    //!
+    //! @param digest MD5 digest of the Rucio key
+    //! @param tag kind of check, -1 for the default one
+    //!
+    //--------------------------------------------------------------------------
+    static std::string MakeKey(const unsigned char* digest, int tag);
+
+    //--------------------------------------------------------------------------
+    //! Drop one reference to a flight and delete it if it was the last one -
+    //! must be called with the flight lock held, which is released
+    //--------------------------------------------------------------------------
+    static void Unref(Flight* flight);
+
+    XrdSysMutex mMutex; ///< mutex protecting the map
+    std::map<std::string, Flight*> mFlights; ///< checks in progress by digest
+};
+
+#endif //__EOS_SINGLEFLIGHT_HH__
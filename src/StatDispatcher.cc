@@ -0,0 +1,325 @@
+// -----------------------------------------------------------------------------
+// File: StatDispatcher.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "StatDispatcher.hh"
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+StatDispatcher::StatDispatcher():
+  mMaxInFlight(0),
+  mMaxQueued(0),
+  mMaxWaitUs(0),
+  mServiceUs(0),
+  mInFlight(0),
+  mNumAdmitted(0),
+  mNumShedFull(0),
+  mNumShedWait(0),
+  mStop(false),
+  mRunning(false)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+StatDispatcher::~StatDispatcher()
+{
+  Stop();
+}
+
+
+//------------------------------------------------------------------------------
+// Set the limits and start the expiry thread
+//------------------------------------------------------------------------------
+bool
+StatDispatcher::Start(unsigned int max_in_flight, unsigned int max_queued,
+                      uint64_t max_wait_us)
+{
+  mMaxInFlight = max_in_flight;
+  mMaxQueued = max_queued;
+  mMaxWaitUs = max_wait_us;
+
+  // The thread is only needed to shed the checks expiring in the queue
+  if (!mMaxInFlight || !mMaxQueued || !mMaxWaitUs)
+    return true;
+
+  if (XrdSysThread::Run(&mTid, StatDispatcher::StartExpiry,
+                        static_cast<void*>(this), XRDSYSTHREAD_HOLD,
+                        "EosRucioCms stat dispatcher"))
+  {
+    mMaxInFlight = 0;
+    return false;
+  }
+
+  mRunning = true;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Stop the expiry thread and shed the queued checks
+//------------------------------------------------------------------------------
+void
+StatDispatcher::Stop()
+{
+  if (mRunning)
+  {
+    mCond.Lock();
+    mStop = true;
+    mCond.Signal();
+    mCond.UnLock();
+    XrdSysThread::Join(mTid, 0);
+    mRunning = false;
+  }
+
+  std::deque<Waiter> admit;
+  std::deque<Waiter> shed;
+  mCond.Lock();
+  shed.swap(mQueue);
+  mNumShedWait += shed.size();
+  mCond.UnLock();
+  Notify(admit, shed);
+}
+
+
+//------------------------------------------------------------------------------
+// Notification of a ticket whose thread blocks while it is queued
+//------------------------------------------------------------------------------
+void
+StatDispatcher::SyncTicket::Admitted(bool admitted)
+{
+  mAdmitted = admitted;
+  mSem.Post();
+}
+
+
+//------------------------------------------------------------------------------
+// Request the admission of a check and block while it is queued
+//------------------------------------------------------------------------------
+bool
+StatDispatcher::Acquire()
+{
+  SyncTicket ticket;
+  Admission admission = Acquire(&ticket);
+
+  if (admission != eQueued)
+    return (admission == eAdmitted);
+
+  ticket.mSem.Wait();
+  return ticket.mAdmitted;
+}
+
+
+//------------------------------------------------------------------------------
+// Request the admission of a check without blocking
+//------------------------------------------------------------------------------
+StatDispatcher::Admission
+StatDispatcher::Acquire(Ticket* ticket)
+{
+  if (!mMaxInFlight)
+    return eAdmitted;
+
+  mCond.Lock();
+
+  // A check only bypasses the queue if nobody is waiting in it
+  if (mQueue.empty() && (mInFlight < mMaxInFlight))
+  {
+    mInFlight++;
+    mNumAdmitted++;
+    mCond.UnLock();
+    return eAdmitted;
+  }
+
+  if (mQueue.size() >= mMaxQueued)
+  {
+    mNumShedFull++;
+    mCond.UnLock();
+    return eShed;
+  }
+
+  // Refuse right away a check which would expire before reaching a slot,
+  // given the recent time a check holds its slot
+  if (mMaxWaitUs && mServiceUs &&
+      ((mQueue.size() + 1) * mServiceUs / mMaxInFlight > mMaxWaitUs))
+  {
+    mNumShedWait++;
+    mCond.UnLock();
+    return eShed;
+  }
+
+  Waiter waiter;
+  waiter.ticket = ticket;
+  waiter.enqueue_us = LatencyStats::NowUs();
+  mQueue.push_back(waiter);
+
+  // Wake up the expiry thread only if the oldest waiter changed
+  if (mQueue.size() == 1)
+    mCond.Signal();
+
+  mCond.UnLock();
+  return eQueued;
+}
+
+
+//------------------------------------------------------------------------------
+// Release the slot of an admitted check
+//------------------------------------------------------------------------------
+void
+StatDispatcher::Release(uint64_t service_us)
+{
+  if (!mMaxInFlight)
+    return;
+
+  std::deque<Waiter> admit;
+  std::deque<Waiter> shed;
+  mCond.Lock();
+  mInFlight--;
+  mServiceUs = (mServiceUs ? (7 * mServiceUs + service_us) / 8 : service_us);
+
+  if (!mQueue.empty())
+    Dequeue(LatencyStats::NowUs(), admit, shed);
+
+  mCond.UnLock();
+  Notify(admit, shed);
+}
+
+
+//------------------------------------------------------------------------------
+// Get the counters of the dispatcher
+//------------------------------------------------------------------------------
+void
+StatDispatcher::GetStats(Stats& stats)
+{
+  mCond.Lock();
+  stats.in_flight = mInFlight;
+  stats.queued = mQueue.size();
+  stats.admitted = mNumAdmitted;
+  stats.shed_full = mNumShedFull;
+  stats.shed_wait = mNumShedWait;
+  mCond.UnLock();
+}
+
+
+//------------------------------------------------------------------------------
+// Move the waiters which can leave the queue into the given lists
+//------------------------------------------------------------------------------
+void
+StatDispatcher::Dequeue(uint64_t now_us, std::deque<Waiter>& admit,
+                        std::deque<Waiter>& shed)
+{
+  while (!mQueue.empty())
+  {
+    const Waiter& waiter = mQueue.front();
+    uint64_t wait_us = now_us - waiter.enqueue_us;
+
+    if (mMaxWaitUs && (wait_us >= mMaxWaitUs))
+    {
+      shed.push_back(waiter);
+      mNumShedWait++;
+    }
+    else if (mInFlight < mMaxInFlight)
+    {
+      admit.push_back(waiter);
+      mInFlight++;
+      mNumAdmitted++;
+    }
+    else
+    {
+      break;
+    }
+
+    mQueueLatency.AddLatency(wait_us);
+    mQueue.pop_front();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+// Notify the waiters which left the queue
+//------------------------------------------------------------------------------
+void
+StatDispatcher::Notify(std::deque<Waiter>& admit, std::deque<Waiter>& shed)
+{
+  for (auto it = shed.begin(); it != shed.end(); ++it)
+    it->ticket->Admitted(false);
+
+  for (auto it = admit.begin(); it != admit.end(); ++it)
+    it->ticket->Admitted(true);
+}
+
+
+//------------------------------------------------------------------------------
+// Expiry thread startup function
+//------------------------------------------------------------------------------
+void*
+StatDispatcher::StartExpiry(void* arg)
+{
+  StatDispatcher* dispatcher = static_cast<StatDispatcher*>(arg);
+  dispatcher->Run();
+  return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Expiry thread loop
+//------------------------------------------------------------------------------
+void
+StatDispatcher::Run()
+{
+  std::deque<Waiter> admit;
+  std::deque<Waiter> shed;
+  mCond.Lock();
+
+  while (!mStop)
+  {
+    if (mQueue.empty())
+    {
+      mCond.Wait();
+      continue;
+    }
+
+    uint64_t now = LatencyStats::NowUs();
+    uint64_t expire_us = mQueue.front().enqueue_us + mMaxWaitUs;
+
+    if (expire_us > now)
+    {
+      mCond.WaitMS(static_cast<int>((expire_us - now + 999) / 1000));
+      continue;
+    }
+
+    // The tickets are notified without the lock since they can start a check
+    Dequeue(now, admit, shed);
+    mCond.UnLock();
+    Notify(admit, shed);
+    admit.clear();
+    shed.clear();
+    mCond.Lock();
+  }
+
+  mCond.UnLock();
+}
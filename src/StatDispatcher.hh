@@ -0,0 +1,252 @@
+// -----------------------------------------------------------------------------
+// File: StatDispatcher.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_STATDISPATCHER_HH__
+#define __EOS_STATDISPATCHER_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "XrdSys/XrdSysPthread.hh"
+#include "LatencyStats.hh"
+/*----------------------------------------------------------------------------*/
+#include <deque>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class StatDispatcher bounding the number of existence checks which have
+//! stat requests in flight to EOS. The checks above the limit wait in a
+//! bounded FIFO queue and are shed, i.e. refused, when the queue is full,
+//! when their expected wait exceeds the limit or when they actually waited
+//! that long. A thread sheds the checks which expire in the queue.
+//------------------------------------------------------------------------------
+class StatDispatcher
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Outcome of an admission request
+    //--------------------------------------------------------------------------
+    enum Admission
+    {
+      eAdmitted, ///< the check can start right away
+      eQueued, ///< the ticket is notified when the check is admitted or shed
+      eShed ///< the check is refused
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Interface of a check waiting in the queue
+    //--------------------------------------------------------------------------
+    class Ticket
+    {
+      public:
+
+        virtual ~Ticket() { }
+
+        //----------------------------------------------------------------------
+        //! Called once, without any lock held, when the check leaves the queue
+        //!
+        //! @param admitted true if the check can start, false if it is shed
+        //!
+        //----------------------------------------------------------------------
+        virtual void Admitted(bool admitted) = 0;
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Counters of the dispatcher
+    //--------------------------------------------------------------------------
+    struct Stats
+    {
+      uint64_t in_flight; ///< checks currently admitted
+      uint64_t queued; ///< checks currently waiting in the queue
+      uint64_t admitted; ///< checks admitted
+      uint64_t shed_full; ///< checks shed because the queue was full
+      uint64_t shed_wait; ///< checks shed because of the time limit
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    StatDispatcher();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~StatDispatcher();
+
+
+    //--------------------------------------------------------------------------
+    //! Set the limits and start the expiry thread. Without this call every
+    //! check is admitted.
+    //!
+    //! @param max_in_flight maximum number of admitted checks, 0 disables
+    //!        the limit
+    //! @param max_queued maximum number of checks waiting in the queue
+    //! @param max_wait_us maximum time in microseconds a check may wait in
+    //!        the queue, 0 disables the limit
+    //!
+    //! @return true if successful, otherwise false
+    //!
+    //--------------------------------------------------------------------------
+    bool Start(unsigned int max_in_flight, unsigned int max_queued,
+               uint64_t max_wait_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Stop the expiry thread and shed the queued checks
+    //--------------------------------------------------------------------------
+    void Stop();
+
+
+    //--------------------------------------------------------------------------
+    //! Request the admission of a check and block while it is queued
+    //!
+    //! @return true if the check is admitted, false if it is shed
+    //!
+    //--------------------------------------------------------------------------
+    bool Acquire();
+
+
+    //--------------------------------------------------------------------------
+    //! Request the admission of a check without blocking
+    //!
+    //! @param ticket notified if the check is queued, not otherwise
+    //!
+    //! @return outcome of the request
+    //!
+    //--------------------------------------------------------------------------
+    Admission Acquire(Ticket* ticket);
+
+
+    //--------------------------------------------------------------------------
+    //! Release the slot of an admitted check and admit the next queued one
+    //!
+    //! @param service_us time in microseconds the check held the slot
+    //!
+    //--------------------------------------------------------------------------
+    void Release(uint64_t service_us);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the counters of the dispatcher
+    //!
+    //! @param stats filled with the counters
+    //!
+    //--------------------------------------------------------------------------
+    void GetStats(Stats& stats);
+
+
+    //--------------------------------------------------------------------------
+    //! Get the time spent in the queue by the checks which were queued
+    //!
+    //! @return latency statistics of the queue
+    //!
+    //--------------------------------------------------------------------------
+    LatencyStats& GetQueueLatency()
+    {
+      return mQueueLatency;
+    }
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Ticket of a check whose thread blocks while it is queued
+    //--------------------------------------------------------------------------
+    class SyncTicket: public Ticket
+    {
+      public:
+
+        SyncTicket(): mSem(0), mAdmitted(false) { }
+
+        virtual void Admitted(bool admitted);
+
+        XrdSysSemaphore mSem; ///< posted when the check leaves the queue
+        bool mAdmitted; ///< true if the check was admitted
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Check waiting in the queue
+    //--------------------------------------------------------------------------
+    struct Waiter
+    {
+      Ticket* ticket; ///< ticket notified when leaving the queue
+      uint64_t enqueue_us; ///< time at which the check was queued
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Expiry thread startup function
+    //--------------------------------------------------------------------------
+    static void* StartExpiry(void* arg);
+
+
+    //--------------------------------------------------------------------------
+    //! Expiry thread loop
+    //--------------------------------------------------------------------------
+    void Run();
+
+
+    //--------------------------------------------------------------------------
+    //! Move the waiters which can leave the queue into the given lists - must
+    //! be called with the lock held
+    //!
+    //! @param now_us current time in microseconds
+    //! @param admit waiters to be admitted
+    //! @param shed waiters to be shed
+    //!
+    //--------------------------------------------------------------------------
+    void Dequeue(uint64_t now_us, std::deque<Waiter>& admit,
+                 std::deque<Waiter>& shed);
+
+
+    //--------------------------------------------------------------------------
+    //! Notify the waiters which left the queue - must be called without the
+    //! lock held
+    //!
+    //! @param admit waiters admitted
+    //! @param shed waiters shed
+    //!
+    //--------------------------------------------------------------------------
+    void Notify(std::deque<Waiter>& admit, std::deque<Waiter>& shed);
+
+    XrdSysCondVar mCond; ///< cond. variable protecting the members below
+    std::deque<Waiter> mQueue; ///< checks waiting for admission, oldest first
+    unsigned int mMaxInFlight; ///< maximum number of admitted checks
+    unsigned int mMaxQueued; ///< maximum number of queued checks
+    uint64_t mMaxWaitUs; ///< maximum time in the queue, 0 if unlimited
+    uint64_t mServiceUs; ///< moving average of the time a check holds a slot
+    uint64_t mInFlight; ///< checks currently admitted
+    uint64_t mNumAdmitted; ///< checks admitted
+    uint64_t mNumShedFull; ///< checks shed because the queue was full
+    uint64_t mNumShedWait; ///< checks shed because of the time limit
+    LatencyStats mQueueLatency; ///< time spent in the queue
+    bool mStop; ///< flag to stop the expiry thread
+    bool mRunning; ///< true if the expiry thread is running
+    pthread_t mTid; ///< expiry thread id
+};
+
+#endif //__EOS_STATDISPATCHER_HH__
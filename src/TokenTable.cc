@@ -0,0 +1,332 @@
+// -----------------------------------------------------------------------------
+// File: TokenTable.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "TokenTable.hh"
+/*----------------------------------------------------------------------------*/
+#include <algorithm>
+#include <cmath>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+// Stripe of hit counters of the current thread, -1 if not assigned yet
+//------------------------------------------------------------------------------
+static __thread int sThreadStripe = -1;
+
+//------------------------------------------------------------------------------
+// Order token indices by decreasing score, the ties keeping the alphabetical
+// order
+//------------------------------------------------------------------------------
+struct CompareScore
+{
+  CompareScore(const std::vector<double>& score):
+    mScore(score)
+  { }
+
+  bool operator()(int first, int second) const
+  {
+    return (mScore[first] > mScore[second]);
+  }
+
+  const std::vector<double>& mScore;
+};
+
+
+//------------------------------------------------------------------------------
+// Constructor
+//------------------------------------------------------------------------------
+TokenTable::TokenTable():
+  mHalfLife(3600),
+  mLatWeight(1.0),
+  mErrWeight(1.0),
+  mLastFoldUs(0),
+  mStride(0),
+  mHits(0),
+  mNextStripe(0),
+  mReaders(0),
+  mEpoch(0),
+  mSnapshot(0),
+  mRetired(0),
+  mRetiredEpoch(0)
+{
+  // empty
+}
+
+
+//------------------------------------------------------------------------------
+// Destructor
+//------------------------------------------------------------------------------
+TokenTable::~TokenTable()
+{
+  for (auto it = mLatency.begin(); it != mLatency.end(); ++it)
+    delete *it;
+
+  for (auto it = mBulkheads.begin(); it != mBulkheads.end(); ++it)
+    delete *it;
+
+  delete[] mHits;
+  delete[] mReaders;
+  delete mSnapshot.load();
+  delete mRetired;
+}
+
+
+//------------------------------------------------------------------------------
+// Set the scoring parameters
+//------------------------------------------------------------------------------
+void
+TokenTable::SetScoring(unsigned int half_life, double lat_weight,
+                       double err_weight)
+{
+  mHalfLife = half_life;
+  mLatWeight = lat_weight;
+  mErrWeight = err_weight;
+}
+
+
+//------------------------------------------------------------------------------
+// Initialize the table
+//------------------------------------------------------------------------------
+void
+TokenTable::Init(const std::map<std::string, uint64_t>& tokens)
+{
+  Snapshot* snapshot = new Snapshot();
+
+  for (auto it = tokens.begin(); it != tokens.end(); ++it)
+  {
+    snapshot->priority.push_back(it->second);
+    mNames.push_back(it->first);
+    mLatency.push_back(new LatencyStats());
+    mBulkheads.push_back(new Bulkhead());
+    mBase.push_back(it->second);
+    // The configured priority is taken as the initial hit rate
+    mRate.push_back(static_cast<double>(it->second));
+  }
+
+  mLastHits.resize(mNames.size(), 0);
+  mLastOk.resize(mNames.size(), 0);
+  mLastErr.resize(mNames.size(), 0);
+  mOk.resize(mNames.size(), 0.0);
+  mErr.resize(mNames.size(), 0.0);
+  Score(snapshot);
+  // Each stripe starts on its own cache line
+  size_t per_line = 64 / sizeof(std::atomic<uint64_t>);
+  mStride = ((mNames.size() + per_line - 1) / per_line) * per_line;
+
+  if (!mStride)
+    mStride = per_line;
+
+  mHits = new std::atomic<uint64_t>[sNumStripes * mStride];
+
+  for (size_t i = 0; i < sNumStripes * mStride; ++i)
+    mHits[i].store(0, std::memory_order_relaxed);
+
+  mReaders = new std::atomic<uint64_t>[sNumStripes * per_line];
+
+  for (size_t i = 0; i < sNumStripes * per_line; ++i)
+    mReaders[i].store(0, std::memory_order_relaxed);
+
+  mLastFoldUs = LatencyStats::NowUs();
+  mSnapshot.store(snapshot);
+}
+
+
+//------------------------------------------------------------------------------
+// Get index of a token
+//------------------------------------------------------------------------------
+int
+TokenTable::GetIndex(const std::string& name) const
+{
+  auto it = std::lower_bound(mNames.begin(), mNames.end(), name);
+
+  if ((it == mNames.end()) || (*it != name))
+    return -1;
+
+  return it - mNames.begin();
+}
+
+
+//------------------------------------------------------------------------------
+// Get stripe of hit counters used by the calling thread
+//------------------------------------------------------------------------------
+std::atomic<uint64_t>*
+TokenTable::GetStripe()
+{
+  return mHits + GetStripeIndex() * mStride;
+}
+
+
+//------------------------------------------------------------------------------
+// Get stripe index of the calling thread
+//------------------------------------------------------------------------------
+int
+TokenTable::GetStripeIndex() const
+{
+  if (sThreadStripe < 0)
+    sThreadStripe = mNextStripe++ & (sNumStripes - 1);
+
+  return sThreadStripe;
+}
+
+
+//------------------------------------------------------------------------------
+// Check if a reader of an epoch is left in any stripe
+//------------------------------------------------------------------------------
+bool
+TokenTable::HasReaders(unsigned int epoch) const
+{
+  size_t per_line = 64 / sizeof(std::atomic<uint64_t>);
+
+  for (size_t stripe = 0; stripe < sNumStripes; ++stripe)
+  {
+    if (mReaders[stripe * per_line + (epoch & 1)].load(std::memory_order_acquire))
+      return true;
+  }
+
+  return false;
+}
+
+
+//------------------------------------------------------------------------------
+// Reference the current probing order
+//------------------------------------------------------------------------------
+TokenTable::SnapshotRef::SnapshotRef(const TokenTable& table)
+{
+  size_t per_line = 64 / sizeof(std::atomic<uint64_t>);
+  std::atomic<uint64_t>* readers = table.mReaders +
+                                   table.GetStripeIndex() * per_line;
+
+  // The reader counts in the epoch it saw before and after registering, so
+  // that a fold checking that epoch can not miss it
+  while (true)
+  {
+    unsigned int epoch = table.mEpoch.load();
+    mReaders = readers + (epoch & 1);
+    mReaders->fetch_add(1);
+
+    if (table.mEpoch.load() == epoch)
+      break;
+
+    mReaders->fetch_sub(1, std::memory_order_release);
+  }
+
+  mSnapshot = table.mSnapshot.load();
+}
+
+
+//------------------------------------------------------------------------------
+// Account for a file found in a token
+//------------------------------------------------------------------------------
+void
+TokenTable::AddHit(int index)
+{
+  GetStripe()[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+// Fold the hit counters and the stat statistics into the scores
+//------------------------------------------------------------------------------
+void
+TokenTable::Fold()
+{
+  // The previous snapshot is freed once the readers of its epoch left. Till
+  // then no new snapshot is published, so that the readers of two epochs
+  // with the same parity are never mixed in a counter.
+  if (mRetired)
+  {
+    if (HasReaders(mRetiredEpoch))
+      return;
+
+    delete mRetired;
+    mRetired = 0;
+  }
+
+  uint64_t now = LatencyStats::NowUs();
+  double decay = 1.0;
+
+  if (mHalfLife)
+    decay = pow(0.5, (now - mLastFoldUs) / (1e6 * mHalfLife));
+
+  mLastFoldUs = now;
+  Snapshot* snapshot = new Snapshot();
+  snapshot->priority = mBase;
+
+  for (size_t index = 0; index < mNames.size(); ++index)
+  {
+    uint64_t hits = 0;
+    uint64_t num_ok, num_err;
+
+    for (size_t stripe = 0; stripe < sNumStripes; ++stripe)
+      hits += mHits[stripe * mStride + index].load(std::memory_order_relaxed);
+
+    mLatency[index]->GetCounters(num_ok, num_err);
+    snapshot->priority[index] += hits;
+    mRate[index] = mRate[index] * decay + (hits - mLastHits[index]);
+    mOk[index] = mOk[index] * decay + (num_ok - mLastOk[index]);
+    mErr[index] = mErr[index] * decay + (num_err - mLastErr[index]);
+    mLastHits[index] = hits;
+    mLastOk[index] = num_ok;
+    mLastErr[index] = num_err;
+  }
+
+  Score(snapshot);
+  // The readers which saw the current epoch may still get the previous
+  // snapshot, the ones which see the next epoch get the new one
+  mRetired = mSnapshot.exchange(snapshot);
+  mRetiredEpoch = mEpoch.fetch_add(1);
+}
+
+
+//------------------------------------------------------------------------------
+// Compute the scores and the probing order of a snapshot
+//------------------------------------------------------------------------------
+void
+TokenTable::Score(Snapshot* snapshot)
+{
+  double total_rate = 0.0;
+
+  for (size_t index = 0; index < mNames.size(); ++index)
+    total_rate += mRate[index];
+
+  for (size_t index = 0; index < mNames.size(); ++index)
+  {
+    // One hit is added to each token so that the ones without recent hits
+    // are still ordered by their cost
+    double share = (mRate[index] + 1.0) / (total_rate + mNames.size());
+    double err_rate = mErr[index] / (mOk[index] + mErr[index] + 1.0);
+    double penalty = mErrWeight * err_rate;
+    double lat_ms = mLatency[index]->GetPercentile(50) / 1000.0;
+
+    if (penalty > 1.0)
+      penalty = 1.0;
+
+    snapshot->order.push_back(index);
+    snapshot->rate.push_back(mRate[index]);
+    snapshot->score.push_back(share * (1.0 - penalty) /
+                              (1.0 + mLatWeight * lat_ms));
+  }
+
+  std::stable_sort(snapshot->order.begin(), snapshot->order.end(),
+                   CompareScore(snapshot->score));
+}
@@ -0,0 +1,283 @@
+// -----------------------------------------------------------------------------
+// File: TokenTable.hh
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+#ifndef __EOS_TOKENTABLE_HH__
+#define __EOS_TOKENTABLE_HH__
+
+/*----------------------------------------------------------------------------*/
+#include "LatencyStats.hh"
+#include "Bulkhead.hh"
+/*----------------------------------------------------------------------------*/
+#include <string>
+#include <map>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Class TokenTable holding the space tokens of the site. The set of tokens is
+//! fixed once Init is called and each token is identified by its index in
+//! alphabetical order. The order in which the tokens are probed is published
+//! as an immutable snapshot reached through one atomic pointer, so readers
+//! never lock. Each reader registers in the counter of the current epoch in
+//! its stripe and the snapshot retired by a fold is only freed once no reader
+//! of its epoch is left. The hits are counted in per-thread stripes and
+//! folded into a new snapshot by the maintenance thread.
+//!
+//! The tokens are ordered by a score meant to minimise the expected time to
+//! find a file when probing them one after the other i.e. the share of the
+//! recent hits of the token divided by the cost of a stat in it:
+//!
+//!   score = share * (1 - err_weight * err_rate) / (1 + lat_weight * p50_ms)
+//!
+//! The hits and the error rate decay exponentially with the configured half
+//! life so that the order follows the data when it moves.
+//------------------------------------------------------------------------------
+class TokenTable
+{
+  public:
+
+    //--------------------------------------------------------------------------
+    //! Number of hit counter stripes, must be a power of two
+    //--------------------------------------------------------------------------
+    static const size_t sNumStripes = 64;
+
+
+    //--------------------------------------------------------------------------
+    //! Immutable probing order of the tokens
+    //--------------------------------------------------------------------------
+    struct Snapshot
+    {
+      std::vector<int> order; ///< token indices by decreasing score
+      std::vector<uint64_t> priority; ///< total hits of each token by index
+      std::vector<double> rate; ///< decayed hits of each token by index
+      std::vector<double> score; ///< score of each token by index
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Constuctor
+    //--------------------------------------------------------------------------
+    TokenTable();
+
+
+    //--------------------------------------------------------------------------
+    //! Destructor
+    //--------------------------------------------------------------------------
+    ~TokenTable();
+
+
+    //--------------------------------------------------------------------------
+    //! Initialize the table - must be called once before any other method
+    //!
+    //! @param tokens map between the space tokens and their initial priority
+    //!
+    //--------------------------------------------------------------------------
+    void Init(const std::map<std::string, uint64_t>& tokens);
+
+
+    //--------------------------------------------------------------------------
+    //! Set the scoring parameters - must be called before Init
+    //!
+    //! @param half_life half life in seconds of the hits and errors, 0 means
+    //!        they never decay
+    //! @param lat_weight weight of the median stat latency in 1/ms
+    //! @param err_weight weight of the stat error rate
+    //!
+    //--------------------------------------------------------------------------
+    void SetScoring(unsigned int half_life, double lat_weight,
+                    double err_weight);
+
+
+    //--------------------------------------------------------------------------
+    //! Get number of tokens
+    //--------------------------------------------------------------------------
+    size_t Size() const
+    {
+      return mNames.size();
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get name of a token
+    //!
+    //! @param index token index
+    //!
+    //--------------------------------------------------------------------------
+    const std::string& GetName(int index) const
+    {
+      return mNames[index];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get index of a token
+    //!
+    //! @param name token name
+    //!
+    //! @return token index or -1 if not found
+    //!
+    //--------------------------------------------------------------------------
+    int GetIndex(const std::string& name) const;
+
+
+    //--------------------------------------------------------------------------
+    //! Get stat latency statistics of a token
+    //!
+    //! @param index token index
+    //!
+    //--------------------------------------------------------------------------
+    LatencyStats* GetLatency(int index) const
+    {
+      return mLatency[index];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Get the limit of the outstanding stats of a token
+    //!
+    //! @param index token index
+    //!
+    //--------------------------------------------------------------------------
+    Bulkhead* GetBulkhead(int index) const
+    {
+      return mBulkheads[index];
+    }
+
+
+    //--------------------------------------------------------------------------
+    //! Reference to the current probing order, valid as long as the object
+    //! lives. The reference must be short-lived since no new snapshot is
+    //! published while a reader of the previous one is left.
+    //--------------------------------------------------------------------------
+    class SnapshotRef
+    {
+      public:
+
+        //----------------------------------------------------------------------
+        //! Constuctor
+        //!
+        //! @param table token table whose current snapshot is referenced
+        //!
+        //----------------------------------------------------------------------
+        SnapshotRef(const TokenTable& table);
+
+
+        //----------------------------------------------------------------------
+        //! Destructor
+        //----------------------------------------------------------------------
+        ~SnapshotRef()
+        {
+          mReaders->fetch_sub(1, std::memory_order_release);
+        }
+
+
+        const Snapshot* operator->() const
+        {
+          return mSnapshot;
+        }
+
+      private:
+
+        SnapshotRef(const SnapshotRef&); ///< not copyable
+        SnapshotRef& operator=(const SnapshotRef&); ///< not assignable
+
+        std::atomic<uint64_t>* mReaders; ///< reader counter of the epoch
+        const Snapshot* mSnapshot; ///< referenced snapshot
+    };
+
+
+    //--------------------------------------------------------------------------
+    //! Account for a file found in a token
+    //!
+    //! @param index token index
+    //!
+    //--------------------------------------------------------------------------
+    void AddHit(int index);
+
+
+    //--------------------------------------------------------------------------
+    //! Fold the hit counters and the stat statistics into the scores and
+    //! publish a new snapshot - called periodically from a single thread
+    //--------------------------------------------------------------------------
+    void Fold();
+
+  private:
+
+    //--------------------------------------------------------------------------
+    //! Compute the scores and the probing order of a snapshot from the
+    //! decayed counters
+    //!
+    //! @param snapshot snapshot with the priorities filled in
+    //!
+    //--------------------------------------------------------------------------
+    void Score(Snapshot* snapshot);
+
+    //--------------------------------------------------------------------------
+    //! Get stripe of hit counters used by the calling thread
+    //--------------------------------------------------------------------------
+    std::atomic<uint64_t>* GetStripe();
+
+
+    //--------------------------------------------------------------------------
+    //! Get stripe index of the calling thread
+    //--------------------------------------------------------------------------
+    int GetStripeIndex() const;
+
+
+    //--------------------------------------------------------------------------
+    //! Check if a reader of an epoch is left in any stripe
+    //!
+    //! @param epoch epoch of the readers
+    //!
+    //--------------------------------------------------------------------------
+    bool HasReaders(unsigned int epoch) const;
+
+    std::vector<std::string> mNames; ///< token names in alphabetical order
+    std::vector<LatencyStats*> mLatency; ///< stat latency of each token
+    std::vector<Bulkhead*> mBulkheads; ///< outstanding stats of each token
+    std::vector<uint64_t> mBase; ///< initial priority of each token
+    std::vector<uint64_t> mLastHits; ///< hits of each token at the last fold
+    std::vector<uint64_t> mLastOk; ///< stat replies at the last fold
+    std::vector<uint64_t> mLastErr; ///< stat errors at the last fold
+    std::vector<double> mRate; ///< decayed hits of each token
+    std::vector<double> mOk; ///< decayed stat replies of each token
+    std::vector<double> mErr; ///< decayed stat errors of each token
+    unsigned int mHalfLife; ///< half life in seconds, 0 for no decay
+    double mLatWeight; ///< weight of the median stat latency in 1/ms
+    double mErrWeight; ///< weight of the stat error rate
+    uint64_t mLastFoldUs; ///< time of the last fold
+    size_t mStride; ///< counters per stripe, rounded up to a cache line
+    std::atomic<uint64_t>* mHits; ///< hit counters, sNumStripes * mStride
+    mutable std::atomic<unsigned int> mNextStripe; ///< stripe for the next
+                                                   ///< new thread
+    std::atomic<uint64_t>* mReaders; ///< readers of the two last epochs in
+                                     ///< each stripe, one cache line a stripe
+    std::atomic<unsigned int> mEpoch; ///< epoch of the current snapshot
+    std::atomic<Snapshot*> mSnapshot; ///< current probing order
+    Snapshot* mRetired; ///< previous snapshot, freed once its readers left
+    unsigned int mRetiredEpoch; ///< epoch of the previous snapshot
+};
+
+#endif //__EOS_TOKENTABLE_HH__
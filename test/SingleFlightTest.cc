@@ -0,0 +1,218 @@
+// -----------------------------------------------------------------------------
+// File: SingleFlightTest.cc
+// Author: Elvin-Alin Sindrilaru - CERN
+// -----------------------------------------------------------------------------
+
+/************************************************************************
+ * EOS - the CERN Disk Storage System                                   *
+ * Copyright (C) 2013 CERN/Switzerland                                  *
+ *                                                                      *
+ * This program is free software: you can redistribute it and/or modify *
+ * it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or    *
+ * (at your option) any later version.                                  *
+ *                                                                      *
+ * This program is distributed in the hope that it will be useful,      *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of       *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        *
+ * GNU General Public License for more details.                         *
+ *                                                                      *
+ * You should have received a copy of the GNU General Public License    *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.*
+ ************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+#include "SingleFlight.hh"
+/*----------------------------------------------------------------------------*/
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+/*----------------------------------------------------------------------------*/
+
+//------------------------------------------------------------------------------
+//! Number of concurrent locates of the same file
+//------------------------------------------------------------------------------
+static const size_t sNumThreads = 500;
+
+static int gNumFailed = 0;
+
+//------------------------------------------------------------------------------
+//! Record a failed check
+//------------------------------------------------------------------------------
+static void
+Check(bool cond, const char* what)
+{
+  if (!cond)
+  {
+    fprintf(stderr, "FAILED: %s\n", what);
+    gNumFailed++;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+//! Follower notified asynchronously
+//------------------------------------------------------------------------------
+class AsyncFollower: public SingleFlight::Waiter
+{
+  public:
+
+    AsyncFollower(): mDone(false) { }
+
+    virtual void FlightDone(const SingleFlight::Result& result)
+    {
+      mResult = result;
+      mDone = true;
+    }
+
+    SingleFlight::Result mResult; ///< result passed by the leader
+    std::atomic<bool> mDone; ///< true once notified
+};
+
+
+//------------------------------------------------------------------------------
+//! State shared by the threads locating the same file
+//------------------------------------------------------------------------------
+struct Round
+{
+  Round(const SingleFlight::Result& result):
+    mResult(result), mNumJoined(0), mNumLeaders(0), mNumFollowers(0),
+    mResults(sNumThreads), mWaiters(sNumThreads)
+  {
+    memset(mDigest, 0xab, sizeof(mDigest));
+  }
+
+  SingleFlight mFlights; ///< object under test
+  SingleFlight::Result mResult; ///< result published by the leader
+  unsigned char mDigest[MD5_DIGEST_LENGTH]; ///< digest of the file
+  std::atomic<size_t> mNumJoined; ///< threads which joined the check
+  std::atomic<size_t> mNumLeaders; ///< threads which led the check
+  std::atomic<size_t> mNumFollowers; ///< followers counted by Complete
+  std::vector<SingleFlight::Result> mResults; ///< result got by each thread
+  std::vector<AsyncFollower> mWaiters; ///< asynchronous followers
+};
+
+
+//------------------------------------------------------------------------------
+//! Locate done by one thread, the odd threads wait asynchronously
+//------------------------------------------------------------------------------
+static void
+Locate(Round* round, size_t index)
+{
+  bool leader = false;
+  SingleFlight::Flight* flight = round->mFlights.Join(round->mDigest, leader);
+  round->mNumJoined++;
+
+  if (leader)
+  {
+    round->mNumLeaders++;
+
+    // The check lasts until every thread joined it
+    while (round->mNumJoined < sNumThreads)
+      usleep(1000);
+
+    round->mNumFollowers = round->mFlights.Complete(round->mDigest, flight,
+                                                    round->mResult);
+    round->mResults[index] = round->mResult;
+  }
+  else if (index % 2)
+  {
+    round->mFlights.Wait(flight, &round->mWaiters[index]);
+
+    while (!round->mWaiters[index].mDone)
+      usleep(1000);
+
+    round->mResults[index] = round->mWaiters[index].mResult;
+  }
+  else
+  {
+    round->mResults[index] = round->mFlights.Wait(flight);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+//! Run concurrent locates of the same file and check that they share the
+//! result of a single leader
+//------------------------------------------------------------------------------
+static void
+RunRound(const SingleFlight::Result& result, const char* name)
+{
+  Round round(result);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 0; i < sNumThreads; ++i)
+    threads.push_back(std::thread(Locate, &round, i));
+
+  for (size_t i = 0; i < sNumThreads; ++i)
+    threads[i].join();
+
+  fprintf(stdout, "%s: leaders=%zu followers=%zu\n", name,
+          round.mNumLeaders.load(), round.mNumFollowers.load());
+  Check(round.mNumLeaders == 1, "exactly one leader");
+  Check(round.mNumFollowers == sNumThreads - 1, "every other thread followed");
+
+  for (size_t i = 0; i < sNumThreads; ++i)
+  {
+    Check((round.mResults[i].pfn == result.pfn) &&
+          (round.mResults[i].endpoint == result.endpoint),
+          "every thread got the result of the leader");
+  }
+
+  // A check started after the completion has a new leader
+  bool leader = false;
+  SingleFlight::Flight* flight = round.mFlights.Join(round.mDigest, leader);
+  Check(leader, "new check after completion");
+  round.mFlights.Complete(round.mDigest, flight, result);
+}
+
+
+//------------------------------------------------------------------------------
+//! Check that the checks of different tags are not shared
+//------------------------------------------------------------------------------
+static void
+RunTags()
+{
+  SingleFlight flights;
+  unsigned char digest[MD5_DIGEST_LENGTH];
+  memset(digest, 0xcd, sizeof(digest));
+  Check(flights.Follow(digest) == 0, "nothing to follow without a check");
+  bool leader = false;
+  SingleFlight::Flight* flight = flights.Join(digest, leader, 3);
+  Check(leader, "leader of the tagged check");
+  Check(flights.Follow(digest) == 0, "untagged locate does not follow");
+  Check(flights.Follow(digest, 2) == 0, "other tag does not follow");
+  SingleFlight::Flight* follower = flights.Follow(digest, 3);
+  Check(follower == flight, "same tag follows");
+  SingleFlight::Result result;
+  result.pfn = "/eos/b/rucio/s/f";
+  result.endpoint = 0;
+  Check(flights.Complete(digest, flight, result, 3) == 1, "one follower");
+  Check(flights.Wait(follower).pfn == result.pfn, "follower got the result");
+  Check(flights.Follow(digest, 3) == 0, "tagged check is gone");
+}
+
+
+int
+main()
+{
+  SingleFlight::Result found;
+  found.pfn = "/eos/a/rucio/s/ab/cd/f";
+  found.endpoint = 2;
+  RunRound(found, "found");
+  // A shed or failed check is shared as well, the followers go to the uplink
+  RunRound(SingleFlight::Result(), "empty");
+  RunTags();
+
+  if (gNumFailed)
+  {
+    fprintf(stderr, "%d checks failed\n", gNumFailed);
+    return 1;
+  }
+
+  fprintf(stdout, "all checks passed\n");
+  return 0;
+}